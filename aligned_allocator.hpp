@@ -0,0 +1,42 @@
+#pragma once
+
+#include "instrumentation.hpp"
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+
+/// @brief minimal allocator handing out storage aligned to `alignment` bytes, e.g. for SIMD loads
+template<typename T, std::size_t alignment>
+struct aligned_allocator {
+    static_assert(alignment >= alignof(void*) && (alignment & (alignment - 1)) == 0,
+        "alignment must be a power of two multiple of the pointer alignment");
+
+    using value_type = T;
+    template<typename U> struct rebind { using other = aligned_allocator<U, alignment>; };
+
+    aligned_allocator() = default;
+    template<typename U> aligned_allocator(const aligned_allocator<U, alignment>&) {}
+
+    T* allocate(const std::size_t n) {
+        void* ptr{};
+        if (posix_memalign(&ptr, alignment, n * sizeof(T)) != 0) throw std::bad_alloc{};
+        instrumentation::count_storage(ptr, n * sizeof(T));
+
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* const ptr, std::size_t) {
+        instrumentation::release_storage(ptr);
+        std::free(ptr);
+    }
+};
+
+template<typename T, typename U, std::size_t alignment>
+inline bool operator==(const aligned_allocator<T, alignment>&, const aligned_allocator<U, alignment>&) {
+    return true;
+}
+
+template<typename T, typename U, std::size_t alignment>
+inline bool operator!=(const aligned_allocator<T, alignment>&, const aligned_allocator<U, alignment>&) {
+    return false;
+}
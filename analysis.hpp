@@ -1,169 +1,247 @@
 #pragma once
 
 #include "circuit.hpp"
-#include "matrix.hpp"
+#include "node_map.hpp"
+#include "sparse_matrix.hpp"
 #include "topology.hpp"
+#include "equations.hpp"
+#include "symbol_table.hpp"
+#include "thread_pool.hpp"
+#include "instrumentation.hpp"
 #include <vector>
-#include <unordered_map>
-#include <ostream>
+#include <memory>
+#include <future>
+#include <string>
+#include <algorithm>
+#include <initializer_list>
 
-struct equation_term {
-    std::string expr;
-    bool sign;
-};
+class analysis {
+public:
+    analysis(const circuit& circuit)
+        : nodes{instrumentation::measure("node_map", [&circuit] { return node_map{circuit}; })}
+        , cir{instrumentation::measure("select_spanning_tree", [this, &circuit] {
+            const auto normalized = instrumentation::measure("normalize", [this, &circuit] {
+                return normalize(nodes.apply(circuit));
+            });
+            return select_spanning_tree(normalized);
+        })}
+        , incidence{instrumentation::measure("incidence", [this] {
+            auto result = reduce_last_row(to_incidence(cir));
+            instrumentation::annotate_matrix("incidence", result);
+            return result;
+        })}
+        , node_num{incidence.row_num()}, branch_num{cir.size()}
+        , b{instrumentation::measure("loop_matrix", [this] {
+            auto result = fundamental_loop_matrix(cir, root_spanning_tree(cir));
+            instrumentation::annotate_matrix("b", result);
+            return result;
+        })}
+        , d{instrumentation::measure("cutset_matrix", [this] {
+            auto result = fundamental_cutset_matrix(b, node_num);
+            instrumentation::annotate_matrix("d", result);
+            return result;
+        })}
+        , symbols{std::make_shared<symbol_table>()}
+        , branch_symbols{instrumentation::measure("intern_names", [this] { return intern_names(*symbols, cir); })}
+        , node_symbols{instrumentation::measure("intern_nodes", [this] { return intern_nodes(*symbols, nodes, node_num); })}
+    {}
 
-using equation = std::vector<equation_term>;
+    equation_list get_kcl_equations() const { return matrix_to_equations(d, unknown_kind::branch_current); }
+    equation_list get_kvl_equations() const { return matrix_to_equations(b, unknown_kind::branch_voltage); }
 
-std::ostream& operator<<(std::ostream& os, const equation& equation) {
-    auto first = true;
-    for (const auto & term : equation) {
-        os << (first ? term.sign ? "-" : "" : term.sign ? " - " : " + ") << term.expr;
-        first = false;
-    }
-    if (!first) os << " = 0";
+    system_of_equations get_model_equations() const {
+        equation_collector collector{symbols};
+        emit_model_equations(collector);
 
-    return os;
-}
+        return collector.release();
+    }
 
-using equations_t = std::vector<equation>;
+    /** \brief generates the model equations one at a time
+        `sink` receives every unknown through add_unknown() first, then every equation through
+        add_equation(). An equation is only valid for the duration of the call, so memory
+        stays bounded by the topology data regardless of the size of the system.
+    */
+    template<typename Sink> void emit_model_equations(Sink& sink) const {
+        // select unknowns: each node's potential, current through voltage-defined branches
+        for (const auto node : ext::range(0, node_num)) {
+            sink.add_unknown({ unknown_kind::node_potential, node_symbols[node] });
+        }
+        for (const auto branch : ext::range(0, branch_num)) {
+            if (cir.is_voltage_defined(branch)) sink.add_unknown({ unknown_kind::branch_current, branch_symbols[branch] });
+        }
 
-std::ostream& operator<<(std::ostream& os, const equations_t& equations) {
-    for (const auto& equation : equations) {
-        os << equation << '\n';
-    }
+        const auto voltage_potentials = instrumentation::measure("voltage_potential_map", [this] {
+            return get_voltage_potential_map();
+        });
+        equation_list equation{symbols};
+
+        {
+            const instrumentation::scoped_phase phase{"node_equations"};
+            for (const auto node : ext::range(0, node_num)) {
+                equation.clear();
+                equation.add_equation();
+
+                // rows of the incidence matrix are the node's adjacency lists, ordered by branch
+                for (const auto& entry : incidence.row(node)) {
+                    const auto branch = entry.col;
+                    const auto el = entry.value;
+                    const auto type = cir.type(branch);
+                    const auto symbol = branch_symbols[branch];
+                    // leave voltage-defined elements as is
+                    if (is_voltage_defined(type)) {
+                        equation.push_back(make_term(coefficient_kind::one, el < 0, symbol,
+                            { unknown_kind::branch_current, symbol }));
+                    } else {
+                        // express branch voltage in terms of node potentials
+                        const auto kind = type == element_type::capacitor ? coefficient_kind::derivative
+                            : type == element_type::resistor ? coefficient_kind::reciprocal
+                            : coefficient_kind::value;
+
+                        if (kind == coefficient_kind::value) {
+                            equation.push_back(make_term(kind, el < 0, symbol));
+                            continue;
+                        }
 
-    return os;
-}
+                        for (const auto& potential : voltage_potentials[branch]) {
+                            equation.push_back(make_term(kind, (el < 0) ^ potential.sign, symbol, potential.get_unknown()));
+                        }
+                    }
+                }
 
-struct system_of_equations {
-    std::vector<std::string> unknowns;
-    equations_t equations;
-};
+                sink.add_equation(equation[0]);
+            }
+        }
 
-std::ostream& operator<<(std::ostream& os, const system_of_equations& system) {
-    os << "unknowns: (";
+        const instrumentation::scoped_phase phase{"branch_equations"};
+        for (const auto branch : ext::range(0, branch_num)) {
+            const auto type = cir.type(branch);
+            if (!is_voltage_defined(type)) continue;
+
+            const auto symbol = branch_symbols[branch];
+            equation.clear();
+            equation.add_equation();
+            equation.append(voltage_potentials[branch]);
+            if (type == element_type::voltage_source) {
+                equation.push_back(make_term(coefficient_kind::value, true, symbol));
+            } else if (type == element_type::inductor) {
+                equation.push_back(make_term(coefficient_kind::derivative, true, symbol,
+                    { unknown_kind::branch_current, symbol }));
+            }
 
-    auto first = true;
-    for (const auto& unknown : system.unknowns) {
-        os << (first ? "" : ", ") << unknown;
-        first = false;
+            sink.add_equation(equation[0]);
+        }
     }
 
-    os << ")^T\n" << system.equations;
+    const symbol_table& get_symbols() const { return *symbols; }
+    const std::shared_ptr<symbol_table>& get_symbol_table() const { return symbols; }
+    /// @brief fundamental loop matrix B, columns are the branches of the spanning tree ordered circuit
+    const sparse_matrix<int>& get_loop_matrix() const { return b; }
+    /// @brief fundamental cut-set matrix D, columns as in get_loop_matrix()
+    const sparse_matrix<int>& get_cutset_matrix() const { return d; }
+    /// @brief element name symbols of the columns of B and D
+    const std::vector<symbol_table::id>& get_branch_symbols() const { return branch_symbols; }
+    /// @brief reduced incidence matrix, rows are the dense node numbers but the reference node's
+    const sparse_matrix<int>& get_incidence_matrix() const { return incidence; }
+    /// @brief the circuit in the branch order of the matrix columns, nodes renumbered densely
+    const circuit& get_circuit() const { return cir; }
+    /// @brief maps the node numbers of the netlist to the dense ones used by the matrices
+    const node_map& get_node_map() const { return nodes; }
 
-    return os;
-}
+private:
+    static std::vector<symbol_table::id> intern_names(symbol_table& symbols, const circuit& circuit) {
+        std::vector<symbol_table::id> result{};
+        result.reserve(circuit.size());
 
-template<typename T> class analysis {
-public:
-    analysis(const circuit& circuit)
-        : cir{select_spanning_tree(normalize(circuit))}
-        , incidence{reduce_last_row(to_incidence(cir))}
-        , node_num{incidence.size()}, branch_num{cir.size()}
-        , incidence_tree{slice(incidence, node_num, node_num)}
-        , incidence_links{slice(incidence, node_num, branch_num - node_num, 0, node_num)}
-        , b{augment(-transpose((invert(incidence_tree) * incidence_links)), identity<int>(branch_num - node_num))}
-        , d{augment(identity<int>(node_num), -transpose(slice(b, branch_num - node_num, node_num)))}
-    {}
+        for (const auto i : ext::range(0, circuit.size())) {
+            result.push_back(symbols.intern(circuit.name_data(i), circuit.name_length(i)));
+        }
 
-    equations_t get_kcl_equations() const { return matrix_to_equations(d, "I"); }
-    equations_t get_kvl_equations() const { return matrix_to_equations(b, "U"); }
+        return result;
+    }
 
-    system_of_equations get_model_equations() const {
-        // select unknowns: each node's potential, current through voltage-defined branches
-        std::vector<std::string> unknowns{node_num};
-        equations_t equations{node_num};
-        const auto voltage_potentials = get_voltage_potential_map(incidence, cir);
+    /// @return symbols of the original numbers of the non-reference nodes, used to name their potentials
+    static std::vector<symbol_table::id> intern_nodes(symbol_table& symbols, const node_map& nodes,
+                                                      const std::size_t node_num) {
+        std::vector<symbol_table::id> result{};
+        result.reserve(node_num);
 
         for (const auto node : ext::range(0, node_num)) {
-            unknowns[node] = "V_" + std::to_string(node);
-            for (const auto branch : ext::range(0, branch_num)) {
-                const auto el = incidence[node][branch];
-                if (el == 0) continue;
-
-                auto& element = cir[branch];
-                // leave voltage-defined elements as is
-                if (element.is_voltage_defined()) {
-                    equations[node].push_back({ "I_" + element.name, el < 0 });
-                } else {
-                    // express branch voltage in terms of node potentials
-                    const auto potential_it = voltage_potentials.find(element.name);
-
-                    if (element.type == element_type::capacitor) {
-                        for (const auto& potential : potential_it->second) {
-                            equations[node].push_back({
-                                element.name + " * d" + potential.expr + "/dt",
-                                static_cast<bool>((el < 0) ^ potential.sign)
-                            });
-                        }
-                    } else if (element.type == element_type::resistor) {
-                        for (const auto& potential : potential_it->second) {
-                            equations[node].push_back({
-                                "1 / " + element.name + " * " + potential.expr,
-                                static_cast<bool>((el < 0) ^ potential.sign)
-                            });
-                        }
-                    } else if (element.type == element_type::current_source) {
-                        equations[node].push_back({ element.name, el < 0 });
-                    }
-                }
-            }
+            result.push_back(symbols.intern(std::to_string(nodes.original(node))));
         }
 
-        for (const auto& element : cir) {
-            if (element.is_voltage_defined()) {
-                unknowns.emplace_back("I_" + element.name);
-
-                const auto potential_it = voltage_potentials.find(element.name);
-                if (element.type == element_type::voltage_source) {
-                    equations.emplace_back(potential_it->second);
-                    equations.back().push_back({ element.name, true });
-                } else if (element.type == element_type::inductor) {
-                    equations.emplace_back(potential_it->second);
-                    equations.back().push_back({ element.name + " * dI_" + element.name + "/dt", true });
-                }
-            }
-        }
-
-        return { std::move(unknowns), std::move(equations) };
+        return result;
     }
 
-private:
-    equations_t matrix_to_equations(const matrix<int>& m, const std::string& symbol) const {
-        equations_t result{m.size()};
+    equation_list matrix_to_equations(const sparse_matrix<int>& m, const unknown_kind kind) const {
+        equation_list result{symbols};
+        result.reserve(m.row_num(), m.nnz());
 
-        for (const auto i : ext::range(0, m.size())) {
-            for (const auto branch : ext::range(0, branch_num)) {
-                const auto el = m[i][branch];
-                if (el != 0) result[i].push_back({ symbol + '_' + cir[branch].name, el < 0 });
+        for (const auto i : ext::range(0, m.row_num())) {
+            result.add_equation();
+            for (const auto& e : m.row(i)) {
+                const auto symbol = branch_symbols[e.col];
+                result.push_back(make_term(coefficient_kind::one, e.value < 0, symbol, { kind, symbol }));
             }
         }
 
         return result;
     }
 
-    using voltage_potential_map = std::unordered_map<std::string, equation>;
+    /** \brief one equation per branch holding its voltage V_tail - V_head in terms of node potentials
+        Read off the branch ends directly, potentials come in node order and the reference node,
+        numbered node_num, contributes nothing.
+    */
+    equation_list get_voltage_potential_map() const {
+        equation_list result{symbols};
+        result.reserve(branch_num, 2 * branch_num);
+
+        for (const auto branch : ext::range(0, branch_num)) {
+            result.add_equation();
 
-    static voltage_potential_map get_voltage_potential_map(const matrix<int>& incidence, const circuit& circuit) {
-        voltage_potential_map result{};
+            const auto tail = cir.tail(branch), head = cir.head(branch);
+            if (tail == head) continue;
 
-        for (const auto branch : ext::range(0, circuit.size())) {
-            auto& item = result[circuit[branch].name];
-            for (const auto node : ext::range(0, incidence.size())) {
-                const auto el = incidence[node][branch];
-                if (el != 0) item.push_back({ "V_" + std::to_string(node), el < 0 });
+            for (const auto node : { std::min(tail, head), std::max(tail, head) }) {
+                if (node == node_num) continue;
+                result.push_back(make_term(coefficient_kind::one, node == head, branch_symbols[branch],
+                    { unknown_kind::node_potential, node_symbols[node] }));
             }
         }
 
         return result;
     }
 
+    const node_map nodes;
     const circuit cir;
-    const matrix<int> incidence;
+    const sparse_matrix<int> incidence;
     const std::size_t node_num;
     const std::size_t branch_num;
-    const matrix<int> incidence_tree;
-    const matrix<int> incidence_links;
-    const matrix<int> b;
-    const matrix<int> d;
+    const sparse_matrix<int> b;
+    const sparse_matrix<int> d;
+    const std::shared_ptr<symbol_table> symbols;
+    const std::vector<symbol_table::id> branch_symbols;
+    const std::vector<symbol_table::id> node_symbols;
 };
+
+/** \brief analyzes every connected component of a circuit on the pool and merges the model equations
+    Each component is referred to its own reference node, see split_components. Unknowns and equations
+    of the merged system are grouped by component, in component order.
+*/
+system_of_equations analyze_components(const std::vector<circuit>& components, thread_pool& pool) {
+    std::vector<std::future<system_of_equations>> results{};
+    results.reserve(components.size());
+    for (const auto& component : components) {
+        results.push_back(pool.submit([&component] {
+            const instrumentation::scoped_phase phase{"component"};
+            return analysis{component}.get_model_equations();
+        }));
+    }
+
+    for (auto& result : results) result.wait();
+
+    std::vector<system_of_equations> systems{};
+    systems.reserve(components.size());
+    for (auto& result : results) systems.push_back(result.get());
+
+    return merge_systems(systems);
+}
@@ -0,0 +1,544 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "circuit_binary.hpp"
+#include "node_map.hpp"
+#include "symbol_table.hpp"
+#include "range.hpp"
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** \brief canonical form of a circuit: elements sorted by type, tail, head and name
+    Unlike normalize(), which orders by type only and keeps the input order otherwise, the result
+    does not depend on the order of the elements. With `relabel_nodes` node numbers are also
+    compacted, so circuits differing by an order-preserving renumbering share a canonical form.
+    Element values play no part in the symbolic analysis and are cleared.
+*/
+inline circuit canonical_form(const circuit& c, const bool relabel_nodes) {
+    const auto source = relabel_nodes ? node_map{c}.apply(c) : c;
+
+    std::vector<std::size_t> order(source.size());
+    for (const auto i : ext::range(0, source.size())) order[i] = i;
+    std::sort(std::begin(order), std::end(order), [&source] (const std::size_t lhs, const std::size_t rhs) {
+        if (source.type(lhs) != source.type(rhs)) return source.type(lhs) < source.type(rhs);
+        if (source.tail(lhs) != source.tail(rhs)) return source.tail(lhs) < source.tail(rhs);
+        if (source.head(lhs) != source.head(rhs)) return source.head(lhs) < source.head(rhs);
+
+        const auto length = std::min(source.name_length(lhs), source.name_length(rhs));
+        const auto compared = std::memcmp(source.name_data(lhs), source.name_data(rhs), length);
+        return compared != 0 ? compared < 0 : source.name_length(lhs) < source.name_length(rhs);
+    });
+
+    auto result = source.permute(order);
+    for (const auto i : ext::range(0, result.size())) result.set_value(i, 0.0);
+
+    return result;
+}
+
+/// @brief the canonical form in the binary circuit format, the content cache entries are addressed by
+inline std::string canonical_bytes(const circuit& c, const bool relabel_nodes) {
+    std::ostringstream os{};
+    circuit_to_binary(os, canonical_form(c, relabel_nodes));
+
+    return os.str();
+}
+
+inline std::uint64_t canonical_hash(const circuit& c, const bool relabel_nodes = false) {
+    const auto bytes = canonical_bytes(c, relabel_nodes);
+    return hash_bytes(bytes.data(), bytes.size());
+}
+
+/** \brief outputs of the analysis of a canonical circuit
+    B and D refer to their columns by the element symbols in `branch_symbols`, all symbols live in
+    the table of `equations`. Node potentials are named by the node numbers of the canonical form.
+*/
+struct analysis_result {
+    std::string canonical;
+    sparse_matrix<int> b;
+    sparse_matrix<int> d;
+    std::vector<symbol_table::id> branch_symbols;
+    system_of_equations equations;
+};
+
+inline analysis_result analyze_canonical(std::string canonical) {
+    const analysis nodal_analyzer{circuit_from_binary(canonical.data(), canonical.data() + canonical.size())};
+
+    return {
+        std::move(canonical),
+        nodal_analyzer.get_loop_matrix(),
+        nodal_analyzer.get_cutset_matrix(),
+        nodal_analyzer.get_branch_symbols(),
+        nodal_analyzer.get_model_equations()
+    };
+}
+
+/** \brief copy of a system with its node potentials renamed after the original node numbers
+    Node potential unknowns come first and in compact node order, see analysis::emit_model_equations,
+    hence the i-th one is the potential of node nodes.original(i).
+*/
+inline system_of_equations rename_nodes(const system_of_equations& system, const node_map& nodes) {
+    const auto symbols = std::make_shared<symbol_table>();
+    system_of_equations result{ {}, equation_list{symbols} };
+    result.unknowns.reserve(system.unknowns.size());
+    result.equations.reserve(system.equations.size(), system.equations.term_num());
+
+    // a node and an element may share a name, so both are remapped separately
+    const auto& source = system.equations.get_symbols();
+    std::vector<symbol_table::id> node_ids(source.size(), symbol_table::npos), ids(source.size(), symbol_table::npos);
+    for (const auto i : ext::range(0, system.unknowns.size())) {
+        const auto var = system.unknowns[i];
+        if (var.kind == unknown_kind::node_potential) node_ids[var.index] = symbols->intern(std::to_string(nodes.original(i)));
+    }
+
+    const auto remap = [&] (const unknown_kind kind, const symbol_table::id symbol) {
+        if (kind == unknown_kind::node_potential) return node_ids[symbol];
+        if (ids[symbol] == symbol_table::npos) ids[symbol] = symbols->intern(source.data(symbol), source.length(symbol));
+        return ids[symbol];
+    };
+
+    for (const auto& var : system.unknowns) result.unknowns.push_back({ var.kind, remap(var.kind, var.index) });
+
+    for (const auto index : ext::range(0, system.equations.size())) {
+        result.equations.add_equation();
+        for (auto term : system.equations[index]) {
+            term.element = remap(unknown_kind::branch_current, term.element);
+            if (term.kind != coefficient_kind::value) term.var = remap(term.var_kind, term.var);
+            result.equations.push_back(term);
+        }
+    }
+
+    return result;
+}
+
+/** \brief copy of the system of the canonical form of `c` listing elements as analysis{c} would
+    The model equations do not depend on the spanning tree, only the branch order of the analysis,
+    normalize() followed by select_spanning_tree(), decides how they are listed: branch currents and
+    branch equations in that order, the terms of each node equation grouped by branch in that order.
+    Node potentials and node equations keep their order, see rename_nodes for their names.
+*/
+inline system_of_equations restore_element_order(const system_of_equations& system, const circuit& c) {
+    const auto compact = node_map{c}.apply(c);
+    const auto normalized = normalized_order(compact);
+    const auto tree = spanning_tree_order(compact.permute(normalized));
+
+    // branch position in the analysis of `c`, by element symbol
+    const auto& symbols = system.equations.get_symbols();
+    std::vector<std::size_t> positions(symbols.size(), c.size());
+    for (const auto position : ext::range(0, tree.size())) {
+        const auto element = normalized[tree[position]];
+        const auto symbol = symbols.find(c.name_data(element), c.name_length(element));
+        if (symbol == symbol_table::npos) throw std::logic_error{"cached system does not belong to the circuit"};
+        positions[symbol] = position;
+    }
+    const auto by_position = [&positions] (const symbol_table::id lhs, const symbol_table::id rhs) {
+        return positions[lhs] < positions[rhs];
+    };
+
+    system_of_equations result{ {}, equation_list{system.equations.get_symbol_table()} };
+    result.unknowns.reserve(system.unknowns.size());
+    result.equations.reserve(system.equations.size(), system.equations.term_num());
+
+    // node potentials come first, then branch currents, each with the branch equation of the same index
+    const auto node_num = static_cast<std::size_t>(std::count_if(std::begin(system.unknowns), std::end(system.unknowns),
+        [] (const unknown& var) { return var.kind == unknown_kind::node_potential; }));
+    std::vector<std::size_t> currents(system.unknowns.size() - node_num);
+    for (const auto i : ext::range(0, currents.size())) currents[i] = node_num + i;
+    std::sort(std::begin(currents), std::end(currents), [&system, &by_position] (const std::size_t lhs, const std::size_t rhs) {
+        return by_position(system.unknowns[lhs].index, system.unknowns[rhs].index);
+    });
+
+    for (const auto i : ext::range(0, node_num)) result.unknowns.push_back(system.unknowns[i]);
+    for (const auto i : currents) result.unknowns.push_back(system.unknowns[i]);
+
+    std::vector<equation_term> terms{};
+    for (const auto i : ext::range(0, node_num)) {
+        const auto equation = system.equations[i];
+        terms.assign(std::begin(equation), std::end(equation));
+        std::stable_sort(std::begin(terms), std::end(terms), [&by_position] (const equation_term& lhs, const equation_term& rhs) {
+            return by_position(lhs.element, rhs.element);
+        });
+
+        result.equations.add_equation();
+        for (const auto& term : terms) result.equations.push_back(term);
+    }
+    for (const auto i : currents) {
+        result.equations.add_equation();
+        result.equations.append(system.equations[i]);
+    }
+
+    return result;
+}
+
+/** \brief on-disk analysis_result format
+    header      magic "CTRESULT", version, byte order mark
+    canonical   the canonical circuit, checked against the one looked up to rule out hash collisions
+    symbols     every symbol of the result
+    matrices    B and D row by row, each row as its length followed by (column, value) pairs
+    branches    symbols of the columns of B and D
+    equations   unknowns, then every equation as its length followed by its terms
+    Integers are stored in the byte order of the writing machine, as in circuit_binary.
+*/
+namespace result_binary {
+    const char magic[8]{ 'C', 'T', 'R', 'E', 'S', 'U', 'L', 'T' };
+    const std::uint32_t version{1};
+
+    class writer {
+    public:
+        explicit writer(std::ostream& os) : os(os) {}
+
+        template<typename U> void put(const U value) { os.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+        void put_bytes(const char* const data, const std::size_t length) {
+            put(static_cast<std::uint64_t>(length));
+            os.write(data, length);
+        }
+
+        void put_matrix(const sparse_matrix<int>& m) {
+            put(static_cast<std::uint64_t>(m.row_num()));
+            put(static_cast<std::uint64_t>(m.col_num()));
+            for (const auto i : ext::range(0, m.row_num())) {
+                put(static_cast<std::uint64_t>(m.row(i).size()));
+                for (const auto& e : m.row(i)) {
+                    put(static_cast<std::uint64_t>(e.col));
+                    put(static_cast<std::int32_t>(e.value));
+                }
+            }
+        }
+
+    private:
+        std::ostream& os;
+    };
+
+    /// @brief bounds-checked cursor over a result file, any overrun means the file is damaged
+    class reader {
+    public:
+        reader(const char* const first, const char* const last) : current{first}, last{last} {}
+
+        template<typename U> U get() {
+            U value;
+            std::memcpy(&value, take(sizeof(value)), sizeof(value));
+            return value;
+        }
+
+        std::string get_bytes() {
+            const auto length = get<std::uint64_t>();
+            return { take(length), static_cast<std::size_t>(length) };
+        }
+
+        sparse_matrix<int> get_matrix() {
+            const auto row_num = get<std::uint64_t>(), col_num = get<std::uint64_t>();
+            check_count(row_num, sizeof(std::uint64_t));
+
+            sparse_matrix<int> result{0, static_cast<std::size_t>(col_num)};
+            for (std::uint64_t i{}; i < row_num; ++i) {
+                result.add_row();
+                const auto entry_num = get<std::uint64_t>();
+                check_count(entry_num, sizeof(std::uint64_t) + sizeof(std::int32_t));
+                for (std::uint64_t j{}; j < entry_num; ++j) {
+                    const auto col = get<std::uint64_t>();
+                    result.push_back(static_cast<std::size_t>(col), get<std::int32_t>());
+                }
+            }
+
+            return result;
+        }
+
+        /// @brief rejects counts of items that could not possibly fit in the rest of the file
+        void check_count(const std::uint64_t count, const std::size_t item_size) const {
+            if (count > static_cast<std::uint64_t>(last - current) / item_size) throw std::runtime_error{"truncated result file"};
+        }
+
+        bool at_end() const { return current == last; }
+
+    private:
+        const char* take(const std::uint64_t length) {
+            if (length > static_cast<std::uint64_t>(last - current)) throw std::runtime_error{"truncated result file"};
+
+            const auto result = current;
+            current += length;
+            return result;
+        }
+
+        const char* current;
+        const char* last;
+    };
+} /* namespace result_binary */
+
+inline void result_to_binary(std::ostream& os, const analysis_result& result) {
+    result_binary::writer out{os};
+    os.write(result_binary::magic, sizeof(result_binary::magic));
+    out.put(result_binary::version);
+    out.put(circuit_binary::byte_order_mark);
+
+    out.put_bytes(result.canonical.data(), result.canonical.size());
+
+    const auto& symbols = result.equations.equations.get_symbols();
+    out.put(static_cast<std::uint64_t>(symbols.size()));
+    for (const auto symbol : ext::range(symbol_table::id{}, static_cast<symbol_table::id>(symbols.size()))) {
+        out.put_bytes(symbols.data(symbol), symbols.length(symbol));
+    }
+
+    out.put_matrix(result.b);
+    out.put_matrix(result.d);
+
+    out.put(static_cast<std::uint64_t>(result.branch_symbols.size()));
+    for (const auto symbol : result.branch_symbols) out.put(symbol);
+
+    const auto& system = result.equations;
+    out.put(static_cast<std::uint64_t>(system.unknowns.size()));
+    for (const auto& var : system.unknowns) {
+        out.put(static_cast<std::uint8_t>(var.kind));
+        out.put(var.index);
+    }
+
+    out.put(static_cast<std::uint64_t>(system.equations.size()));
+    for (const auto index : ext::range(0, system.equations.size())) {
+        const auto equation = system.equations[index];
+        out.put(static_cast<std::uint64_t>(equation.size()));
+        for (const auto& term : equation) {
+            out.put(static_cast<std::uint8_t>(term.kind));
+            out.put(static_cast<std::uint8_t>(term.var_kind));
+            out.put(static_cast<std::uint8_t>(term.sign));
+            out.put(term.element);
+            out.put(term.var);
+        }
+    }
+
+    if (!os) throw std::runtime_error{"could not write analysis result"};
+}
+
+inline analysis_result result_from_binary(const char* const first, const char* const last) {
+    if (static_cast<std::size_t>(last - first) < sizeof(result_binary::magic) ||
+        std::memcmp(first, result_binary::magic, sizeof(result_binary::magic)) != 0) {
+        throw std::runtime_error{"not an analysis result file"};
+    }
+
+    result_binary::reader in{first + sizeof(result_binary::magic), last};
+    const auto version = in.get<std::uint32_t>();
+    if (version != result_binary::version) {
+        throw std::runtime_error{"unsupported analysis result version " + std::to_string(version)};
+    }
+    if (in.get<std::uint32_t>() != circuit_binary::byte_order_mark) {
+        throw std::runtime_error{"analysis result has foreign byte order"};
+    }
+
+    auto canonical = in.get_bytes();
+
+    const auto symbols = std::make_shared<symbol_table>();
+    const auto symbol_num = in.get<std::uint64_t>();
+    in.check_count(symbol_num, sizeof(std::uint64_t));
+    for (std::uint64_t i{}; i < symbol_num; ++i) symbols->intern(in.get_bytes());
+    if (symbols->size() != symbol_num) throw std::runtime_error{"duplicate symbols in analysis result"};
+
+    const auto check_symbol = [&symbols] (const symbol_table::id symbol) {
+        if (symbol >= symbols->size()) throw std::runtime_error{"invalid symbol in analysis result"};
+        return symbol;
+    };
+
+    auto b = in.get_matrix();
+    auto d = in.get_matrix();
+
+    std::vector<symbol_table::id> branch_symbols{};
+    const auto branch_num = in.get<std::uint64_t>();
+    in.check_count(branch_num, sizeof(symbol_table::id));
+    branch_symbols.reserve(static_cast<std::size_t>(branch_num));
+    for (std::uint64_t i{}; i < branch_num; ++i) branch_symbols.push_back(check_symbol(in.get<symbol_table::id>()));
+
+    system_of_equations system{ {}, equation_list{symbols} };
+    const auto unknown_num = in.get<std::uint64_t>();
+    in.check_count(unknown_num, sizeof(std::uint8_t) + sizeof(std::uint32_t));
+    for (std::uint64_t i{}; i < unknown_num; ++i) {
+        const auto kind = in.get<std::uint8_t>();
+        if (kind > static_cast<std::uint8_t>(unknown_kind::branch_voltage)) throw std::runtime_error{"invalid unknown in analysis result"};
+        system.unknowns.push_back({ static_cast<unknown_kind>(kind), check_symbol(in.get<std::uint32_t>()) });
+    }
+
+    const auto equation_num = in.get<std::uint64_t>();
+    in.check_count(equation_num, sizeof(std::uint64_t));
+    for (std::uint64_t i{}; i < equation_num; ++i) {
+        system.equations.add_equation();
+
+        const auto term_num = in.get<std::uint64_t>();
+        in.check_count(term_num, 3 * sizeof(std::uint8_t) + 2 * sizeof(std::uint32_t));
+        for (std::uint64_t j{}; j < term_num; ++j) {
+            const auto kind = in.get<std::uint8_t>(), var_kind = in.get<std::uint8_t>(), sign = in.get<std::uint8_t>();
+            const auto element = check_symbol(in.get<std::uint32_t>());
+            const auto var = in.get<std::uint32_t>();
+            if (kind > static_cast<std::uint8_t>(coefficient_kind::derivative) ||
+                var_kind > static_cast<std::uint8_t>(unknown_kind::branch_voltage)) {
+                throw std::runtime_error{"invalid term in analysis result"};
+            }
+
+            const auto term = make_term(static_cast<coefficient_kind>(kind), sign != 0, element,
+                { static_cast<unknown_kind>(var_kind), var });
+            if (term.kind != coefficient_kind::value) check_symbol(term.var);
+            system.equations.push_back(term);
+        }
+    }
+
+    if (!in.at_end()) throw std::runtime_error{"trailing data in analysis result"};
+
+    return { std::move(canonical), std::move(b), std::move(d), std::move(branch_symbols), std::move(system) };
+}
+
+/** \brief content-addressed cache of analysis results
+    Circuits are looked up by the hash of their canonical form, an entry only matches if its canonical
+    form is the same, so hash collisions cost a miss and never a wrong result. Up to `capacity` results
+    are kept in memory and evicted least recently used first. If a directory is given, every result is
+    also stored there as <hash>.result and read back on a memory miss, so it outlives the process.
+    The analysis of a miss runs on the canonical form, get_model_equations() restores the element order
+    of the circuit looked up, so results are the same as without a cache. Safe to use from several threads.
+*/
+class analysis_cache {
+public:
+    explicit analysis_cache(const std::size_t capacity, std::string directory = {}, const bool relabel_nodes = false)
+        : capacity{capacity}, directory{std::move(directory)}, relabel_nodes{relabel_nodes}, hit_num{}, miss_num{} {
+        if (!this->directory.empty() && ::mkdir(this->directory.c_str(), 0777) != 0 && errno != EEXIST) {
+            throw std::runtime_error{"could not create directory " + this->directory};
+        }
+    }
+
+    analysis_cache(const analysis_cache&) = delete;
+    analysis_cache& operator=(const analysis_cache&) = delete;
+
+    /// @return analysis outputs of the canonical form of `c`, computed only if not cached yet
+    std::shared_ptr<const analysis_result> get(const circuit& c) {
+        auto canonical = canonical_bytes(c, relabel_nodes);
+        const std::uint64_t key{hash_bytes(canonical.data(), canonical.size())};
+
+        if (const auto cached = find_in_memory(key, canonical)) return cached;
+
+        auto result = load(key, canonical);
+        if (!result) {
+            result = std::make_shared<const analysis_result>(analyze_canonical(std::move(canonical)));
+            store(key, *result);
+        }
+
+        insert(key, result);
+        return result;
+    }
+
+    /// @brief model equations of `c` as analysis{c} gives them, element order and node numbers restored
+    system_of_equations get_model_equations(const circuit& c) {
+        const auto result = get(c);
+        auto system = restore_element_order(result->equations, c);
+
+        return relabel_nodes ? rename_nodes(system, node_map{c}) : system;
+    }
+
+    std::size_t hits() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return hit_num;
+    }
+
+    std::size_t misses() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return miss_num;
+    }
+
+private:
+    using entry = std::pair<std::uint64_t, std::shared_ptr<const analysis_result>>;
+
+    std::shared_ptr<const analysis_result> find_in_memory(const std::uint64_t key, const std::string& canonical) {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        const auto it = index.find(key);
+        if (it == std::end(index) || it->second->second->canonical != canonical) return nullptr;
+
+        entries.splice(std::begin(entries), entries, it->second);
+        ++hit_num;
+        return it->second->second;
+    }
+
+    void insert(const std::uint64_t key, const std::shared_ptr<const analysis_result>& result) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (capacity == 0) return;
+
+        // a colliding entry is simply replaced, as is one inserted meanwhile by another thread
+        const auto it = index.find(key);
+        if (it != std::end(index)) entries.erase(it->second);
+
+        entries.emplace_front(key, result);
+        index[key] = std::begin(entries);
+
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    std::string path(const std::uint64_t key) const {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return directory + '/' + name + ".result";
+    }
+
+    /// @brief reads a stored result, a missing, damaged or colliding file counts as a miss
+    std::shared_ptr<const analysis_result> load(const std::uint64_t key, const std::string& canonical) {
+        std::shared_ptr<const analysis_result> result{};
+
+        if (!directory.empty()) {
+            std::ifstream is{path(key), std::ios::binary};
+            if (is) {
+                const std::string bytes{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+                try {
+                    auto stored = result_from_binary(bytes.data(), bytes.data() + bytes.size());
+                    if (stored.canonical == canonical) result = std::make_shared<const analysis_result>(std::move(stored));
+                } catch (const std::runtime_error&) {}
+            }
+        }
+
+        std::lock_guard<std::mutex> lock{mutex};
+        ++(result ? hit_num : miss_num);
+        return result;
+    }
+
+    /// @brief writes to a temporary file first, so concurrent readers never see a partial result
+    void store(const std::uint64_t key, const analysis_result& result) const {
+        if (directory.empty()) return;
+
+        const auto target = path(key);
+        // unique among the processes and threads sharing the directory
+        const auto temporary = target + '.' + std::to_string(::getpid()) + '.' +
+            std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream os{temporary, std::ios::binary};
+            if (!os) throw std::runtime_error{"could not open file " + temporary};
+            result_to_binary(os, result);
+        }
+
+        if (std::rename(temporary.c_str(), target.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            throw std::runtime_error{"could not write file " + target};
+        }
+    }
+
+    const std::size_t capacity;
+    const std::string directory;
+    const bool relabel_nodes;
+
+    mutable std::mutex mutex;
+    /// most recently used first
+    std::list<entry> entries;
+    std::unordered_map<std::uint64_t, std::list<entry>::iterator> index;
+    std::size_t hit_num;
+    std::size_t miss_num;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "analysis_cache.hpp"
+#include "circuit_from_stream.hpp"
+#include "equation_writer.hpp"
+#include "thread_pool.hpp"
+#include "range.hpp"
+#include <string>
+#include <vector>
+#include <set>
+#include <fstream>
+#include <ostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+
+/** \brief writes the model equations of a circuit with any number of connected components
+    A connected circuit is streamed straight to the output. Otherwise components are analyzed on
+    `pool` if one is given and sequentially if not, then merged, see analyze_components.
+    With a `cache` every component is looked up there instead, so repeated subcircuits are analyzed once.
+*/
+void write_model_equations(std::ostream& os, const circuit& c, thread_pool* const pool = nullptr,
+                           analysis_cache* const cache = nullptr) {
+    const auto components = instrumentation::measure("split_components", [&c] { return split_components(c); });
+    if (cache && !components.empty()) {
+        std::vector<system_of_equations> systems{};
+        systems.reserve(components.size());
+        if (pool && components.size() > 1) {
+            std::vector<std::future<system_of_equations>> results{};
+            results.reserve(components.size());
+            for (const auto& component : components) {
+                results.push_back(pool->submit([&component, cache] { return cache->get_model_equations(component); }));
+            }
+
+            for (auto& result : results) result.wait();
+            for (auto& result : results) systems.push_back(result.get());
+        } else {
+            for (const auto& component : components) systems.push_back(cache->get_model_equations(component));
+        }
+
+        const auto system = systems.size() == 1 ? std::move(systems.front()) : merge_systems(systems);
+        equation_writer writer{os, system.equations.get_symbols()};
+        emit_system(system, writer);
+        writer.finish();
+        return;
+    }
+
+    if (components.size() <= 1) {
+        const auto nodal_analyzer = instrumentation::measure("analysis", [&c] { return analysis{c}; });
+
+        const instrumentation::scoped_phase phase{"emit_model_equations"};
+        equation_writer writer{os, nodal_analyzer.get_symbols()};
+        nodal_analyzer.emit_model_equations(writer);
+        writer.finish();
+        return;
+    }
+
+    auto system = pool ? analyze_components(components, *pool) : [&components] {
+        std::vector<system_of_equations> systems{};
+        systems.reserve(components.size());
+        for (const auto& component : components) systems.push_back(analysis{component}.get_model_equations());
+
+        return merge_systems(systems);
+    }();
+
+    equation_writer writer{os, system.equations.get_symbols()};
+    emit_system(system, writer);
+    writer.finish();
+}
+
+namespace {
+    inline bool is_directory(const std::string& path) {
+        struct stat st{};
+        return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    inline bool is_regular_file(const std::string& path) {
+        struct stat st{};
+        return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+
+    inline std::string base_name(const std::string& path) {
+        const auto slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+}
+
+/** \brief netlists named by a batch source
+    A directory yields its regular files not starting with a dot, sorted by name. Any other file is
+    read as a manifest listing one netlist path per line, empty lines and lines starting with # are skipped.
+*/
+std::vector<std::string> list_netlists(const std::string& source) {
+    std::vector<std::string> result{};
+
+    if (is_directory(source)) {
+        const auto dir = ::opendir(source.c_str());
+        if (!dir) throw std::runtime_error{"could not open directory " + source};
+
+        while (const auto entry = ::readdir(dir)) {
+            const std::string name{entry->d_name};
+            const auto path = source + '/' + name;
+            if (name[0] != '.' && is_regular_file(path)) result.push_back(path);
+        }
+        ::closedir(dir);
+
+        std::sort(std::begin(result), std::end(result));
+        return result;
+    }
+
+    std::ifstream manifest{source};
+    if (!manifest) throw std::runtime_error{"could not open file " + source};
+
+    for (std::string line; std::getline(manifest, line); ) {
+        const auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        const auto last = line.find_last_not_of(" \t\r");
+        result.push_back(line.substr(first, last - first + 1));
+    }
+
+    return result;
+}
+
+struct batch_result {
+    std::string input;
+    std::string output;
+    bool succeeded;
+    std::string error;
+    std::size_t element_num;
+    double seconds;
+};
+
+/** \brief analyzes every netlist as a task of its own and writes its equations to a file in `output_dir`
+    Output files are named after the netlist with an .out suffix, a name already taken also gets the
+    index of the netlist in the list, repeatedly if need be, so no two netlists share an output. Failures are recorded in the result rather than thrown.
+*/
+std::vector<batch_result> run_batch(const std::vector<std::string>& inputs, const std::string& output_dir,
+                                    thread_pool& pool, analysis_cache* const cache = nullptr) {
+    if (::mkdir(output_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error{"could not create directory " + output_dir};
+    }
+
+    std::vector<batch_result> results(inputs.size());
+    std::set<std::string> names{};
+    for (const auto i : ext::range(0, inputs.size())) {
+        // a taken name gets the index of the netlist appended, as often as needed to be unique
+        auto name = base_name(inputs[i]);
+        while (!names.insert(name).second) name += '.' + std::to_string(i);
+
+        results[i] = { inputs[i], output_dir + '/' + name + ".out", false, {}, 0, 0.0 };
+    }
+
+    parallel_for(pool, inputs.size(), [&results, cache] (const std::size_t i) {
+        auto& result = results[i];
+        const auto start = std::chrono::steady_clock::now();
+
+        try {
+            const auto c = instrumentation::measure("parse", [&result] { return circuit_from_file(result.input); });
+            result.element_num = c.size();
+
+            std::ofstream os{result.output};
+            if (!os) throw std::runtime_error{"could not open file " + result.output};
+            write_model_equations(os, c, nullptr, cache);
+            os << std::endl;
+            if (!os) throw std::runtime_error{"could not write file " + result.output};
+
+            result.succeeded = true;
+        } catch (const std::exception& e) {
+            result.error = e.what();
+            std::remove(result.output.c_str());
+        }
+
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    });
+
+    return results;
+}
+
+/// @brief one line per netlist in input order followed by the totals
+void write_batch_summary(std::ostream& os, const std::vector<batch_result>& results, const double seconds) {
+    std::size_t failed{}, element_num{};
+    os << std::fixed << std::setprecision(3);
+
+    for (const auto& result : results) {
+        os << (result.succeeded ? "ok     " : "failed ") << std::setw(9) << result.seconds << "s  " << result.input;
+        if (result.succeeded) {
+            os << " (" << result.element_num << " elements) -> " << result.output << '\n';
+        } else {
+            os << ": " << result.error << '\n';
+        }
+
+        failed += !result.succeeded;
+        element_num += result.element_num;
+    }
+
+    os << "batch: " << results.size() << " netlists, " << results.size() - failed << " ok, " << failed << " failed, "
+        << element_num << " elements in " << seconds << "s\n";
+}
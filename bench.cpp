@@ -0,0 +1,530 @@
+#include "analysis.hpp"
+#include "batch.hpp"
+#include "circuit_from_stream.hpp"
+#include "circuit_generators.hpp"
+#include "determinant_diagram.hpp"
+#include "incremental_analysis.hpp"
+#include "mna.hpp"
+#include "transient.hpp"
+#include "matrix.hpp"
+#include "topology.hpp"
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <complex>
+#include <cmath>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <typeinfo>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <malloc.h>
+#include <sys/resource.h>
+
+// bench [--filter substring] [--min-time seconds] [--scale factor]
+// runs every benchmark whose name contains the filter and prints one JSON object per line
+// bench --check
+// runs the correctness checks only and fails with the first mismatch
+
+namespace {
+    /// heap traffic through operator new and the aligned matrix storage from posix_memalign
+    std::atomic<std::size_t> allocation_num{}, live_bytes{}, peak_bytes{};
+
+    void track(void* const ptr) {
+        ++allocation_num;
+        const auto live = live_bytes += malloc_usable_size(ptr);
+        for (auto peak = peak_bytes.load(); live > peak && !peak_bytes.compare_exchange_weak(peak, live); ) {}
+    }
+
+    void untrack(void* const ptr) { live_bytes -= malloc_usable_size(ptr); }
+
+    const instrumentation::storage_hooks storage_tracking{ track, untrack };
+
+    void* counted_allocate(const std::size_t size) {
+        const auto ptr = std::malloc(size != 0 ? size : 1);
+        if (!ptr) throw std::bad_alloc{};
+
+        track(ptr);
+        return ptr;
+    }
+
+    void counted_free(void* const ptr) {
+        if (!ptr) return;
+
+        untrack(ptr);
+        std::free(ptr);
+    }
+}
+
+void* operator new(const std::size_t size) { return counted_allocate(size); }
+void* operator new[](const std::size_t size) { return counted_allocate(size); }
+void operator delete(void* const ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr) noexcept { counted_free(ptr); }
+void operator delete(void* const ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr, std::size_t) noexcept { counted_free(ptr); }
+
+namespace {
+    /// @brief stream buffer discarding its output, so that writing benchmarks measure formatting only
+    class null_buffer : public std::streambuf {
+    protected:
+        int_type overflow(const int_type c) override { return traits_type::not_eof(c); }
+        std::streamsize xsputn(const char*, const std::streamsize n) override { return n; }
+    };
+
+    std::atomic<std::size_t> sink{};
+
+    /// @brief keeps the compiler from dropping a computation whose result is otherwise unused
+    inline void keep(const std::size_t value) { sink += value; }
+
+    /// @brief high-water mark of the resident set over the whole process so far, not of one benchmark
+    std::size_t process_max_rss_bytes() {
+        struct rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+    }
+
+    struct options {
+        std::string filter;
+        double min_time;
+        double scale;
+    };
+
+    /** \brief times `body` until it ran at least three times and for at least `min_time` seconds
+        Reports the median time of an iteration, `items` processed per iteration and second, heap
+        allocations per iteration and the peak of live heap memory above what was live beforehand.
+        The resident set size reported is cumulative, it only grows from one benchmark to the next.
+    */
+    void run(const options& opts, const std::string& name, const std::string& input, const std::size_t items,
+             const std::function<void()>& body) {
+        if (name.find(opts.filter) == std::string::npos) return;
+
+        body();
+
+        // reserved up front, the harness's own allocations would otherwise be counted against `body`
+        std::vector<double> times{};
+        times.reserve(1000);
+
+        const auto baseline = live_bytes.load();
+        peak_bytes = baseline;
+        const auto allocations_before = allocation_num.load();
+
+        double total{};
+        while (times.size() < 3 || (total < opts.min_time && times.size() < 1000)) {
+            const auto start = std::chrono::steady_clock::now();
+            body();
+            times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            total += times.back();
+        }
+
+        const auto allocations = (allocation_num.load() - allocations_before) / times.size();
+        const auto heap_peak = peak_bytes.load() - baseline;
+
+        std::nth_element(std::begin(times), std::begin(times) + times.size() / 2, std::end(times));
+        const auto median = times[times.size() / 2];
+
+        std::cout << "{\"benchmark\": \"" << name << "\", \"input\": \"" << input << "\", \"items\": " << items
+            << ", \"iterations\": " << times.size() << ", \"seconds\": " << median
+            << ", \"items_per_second\": " << (median > 0 ? items / median : 0.0)
+            << ", \"allocations\": " << allocations << ", \"heap_peak_bytes\": " << heap_peak
+            << ", \"process_max_rss_bytes\": " << process_max_rss_bytes() << "}" << std::endl;
+    }
+
+    std::size_t scaled(const options& opts, const std::size_t size) {
+        return std::max<std::size_t>(2, static_cast<std::size_t>(size * opts.scale));
+    }
+
+    template<typename T> matrix<T> to_dense_as(const sparse_matrix<int>& m) {
+        matrix<T> result{m.row_num(), m.col_num()};
+        for (const auto i : ext::range(0, m.row_num())) {
+            for (const auto& e : m.row(i)) result[i][e.col] = static_cast<T>(e.value);
+        }
+
+        return result;
+    }
+
+    /// @brief rendered unknowns, each equation as its sorted rendered terms, then sorted, so order does not matter
+    std::vector<std::string> canonical_form(const system_of_equations& system) {
+        const auto& symbols = system.equations.get_symbols();
+        const auto render = [&symbols] (const unknown u) {
+            return std::to_string(static_cast<int>(u.kind)) + symbols.str(u.index);
+        };
+
+        std::vector<std::string> result{};
+        for (const auto& u : system.unknowns) result.push_back("unknown " + render(u));
+        for (const auto i : ext::range(0, system.equations.size())) {
+            std::vector<std::string> terms{};
+            for (const auto& t : system.equations[i]) {
+                auto term = std::to_string(static_cast<int>(t.kind)) + (t.sign ? " - " : " + ");
+                if (t.kind != coefficient_kind::one) term += symbols.str(t.element) + ' ';
+                if (t.kind != coefficient_kind::value) term += render(t.get_unknown());
+                terms.push_back(term);
+            }
+
+            std::sort(std::begin(terms), std::end(terms));
+            std::string equation{};
+            for (const auto& term : terms) equation += term + ';';
+            result.push_back(equation);
+        }
+        std::sort(std::begin(result), std::end(result));
+
+        return result;
+    }
+
+    /// @brief fundamental equations as coefficient rows keyed by element name
+    std::vector<std::map<std::string, int>> to_rows(const equation_list& equations) {
+        std::vector<std::map<std::string, int>> result(equations.size());
+        for (const auto i : ext::range(0, equations.size())) {
+            for (const auto& t : equations[i]) result[i][equations.get_symbols().str(t.var)] = t.sign ? -1 : 1;
+        }
+
+        return result;
+    }
+
+    std::size_t rank(const std::vector<std::map<std::string, int>>& rows, const std::map<std::string, std::size_t>& columns) {
+        matrix<int> m{rows.size(), columns.size()};
+        for (const auto i : ext::range(0, rows.size())) {
+            for (const auto& e : rows[i]) m[i][columns.at(e.first)] = e.second;
+        }
+
+        const auto echelon = echelonize(m);
+        std::size_t result{};
+        for (const auto i : ext::range(0, echelon.row_num())) {
+            const auto row = echelon.get_row(i);
+            if (std::any_of(std::begin(row), std::end(row), [] (const int value) { return value != 0; })) ++result;
+        }
+
+        return result;
+    }
+
+    /** \brief checks an incrementally maintained model against a fresh analysis of the edited circuit
+        Model equations must be the same up to order. The fundamental equations may come from another
+        tree, so their counts must agree and they must span the same spaces: the loops are independent
+        and orthogonal to the fresh cut-sets, and the other way round.
+    */
+    void check_incremental(const incremental_analysis& model, const circuit& edited) {
+        const analysis fresh{edited};
+        if (canonical_form(model.get_model_equations()) != canonical_form(fresh.get_model_equations())) {
+            throw std::runtime_error{"incremental model equations differ from a fresh analysis"};
+        }
+
+        std::map<std::string, std::size_t> columns{};
+        for (const auto i : ext::range(0, edited.size())) columns.emplace(edited.name(i), columns.size());
+
+        const auto check = [&columns] (const equation_list& rows, const equation_list& fresh_rows,
+                                       const equation_list& fresh_complement, const char* const what) {
+            const auto model_rows = to_rows(rows), complement = to_rows(fresh_complement);
+            if (model_rows.size() != fresh_rows.size() || rank(model_rows, columns) != model_rows.size()) {
+                throw std::runtime_error{std::string{"incremental "} + what + " equations are not a basis"};
+            }
+
+            for (const auto& row : model_rows) {
+                for (const auto& other : complement) {
+                    int product{};
+                    for (const auto& e : row) {
+                        const auto it = other.find(e.first);
+                        if (it != std::end(other)) product += e.second * it->second;
+                    }
+                    if (product != 0) throw std::runtime_error{std::string{"incremental "} + what + " equations are wrong"};
+                }
+            }
+        };
+        check(model.get_kcl_equations(), fresh.get_kcl_equations(), fresh.get_kvl_equations(), "KCL");
+        check(model.get_kvl_equations(), fresh.get_kvl_equations(), fresh.get_kcl_equations(), "KVL");
+    }
+
+    /** \brief random edits of a grid, applied to an incremental_analysis and a plain element list alike
+        Grid nodes are renumbered to even numbers so that new nodes, odd and below the ground node,
+        leave the reference node in place. Removals spare the voltage and current sources so that the
+        grid stays connected.
+    */
+    void check_incremental_edits(const std::size_t side, const std::size_t edit_num) {
+        auto grid = generators::resistor_grid(side, side);
+        for (const auto i : ext::range(0, grid.size())) grid.set_nodes(i, 2 * grid.tail(i), 2 * grid.head(i));
+
+        std::vector<element> elements{};
+        for (const auto i : ext::range(0, grid.size())) elements.push_back(grid[i]);
+        incremental_analysis model{grid};
+
+        std::mt19937 engine{1};
+        const auto pick = [&engine] (const std::size_t n) { return std::uniform_int_distribution<std::size_t>{0, n - 1}(engine); };
+        const element_type types[]{ element_type::voltage_source, element_type::capacitor, element_type::resistor,
+            element_type::inductor, element_type::current_source };
+        const auto grid_node_num = side * side;
+        std::size_t next_node{1};
+        for (const auto edit : ext::range(0, edit_num)) {
+            const auto name = "X" + std::to_string(edit);
+            switch (pick(4)) {
+            case 0: {
+                const auto tail = 2 * pick(grid_node_num), head = 2 * pick(grid_node_num);
+                elements.push_back({ types[1 + pick(3)], tail, head, name, 1.0 });
+                model.add_element(elements.back());
+                break;
+            }
+            case 1:
+                // a new leaf node, numbered below the ground node
+                if (next_node >= 2 * grid_node_num) continue;
+                elements.push_back({ element_type::resistor, 2 * pick(grid_node_num), next_node, name, 1.0 });
+                next_node += 2;
+                model.add_element(elements.back());
+                break;
+            case 2: {
+                const auto i = 2 + pick(elements.size() - 2);
+                elements[i].type = types[pick(5)];
+                model.retype_element(elements[i].name, elements[i].type);
+                break;
+            }
+            default: {
+                const auto i = 2 + pick(elements.size() - 2);
+                try {
+                    model.remove_element(elements[i].name);
+                } catch (const std::runtime_error&) {
+                    continue; // the element was a bridge
+                }
+                elements.erase(std::begin(elements) + i);
+            }
+            }
+        }
+
+        circuit edited{};
+        for (const auto& el : elements) edited.push_back(el);
+        check_incremental(model, edited);
+    }
+
+    /** \brief checks symbolic network functions against the numeric AC solve
+        Includes a circuit whose output is shorted, so the numerator diagram is the zero terminal.
+    */
+    void check_network_functions() {
+        const auto parse = [] (const std::string& text) { return circuit_from_buffer(text.data(), text.data() + text.size()); };
+
+        const auto shorted = parse("E1 0 1 1\nR1 1 2 1k\nR2 2 3 1k\nE2 2 3 0\nR3 1 3 1k\n");
+        const auto zero = make_network_function(analysis{shorted}, "E1", 2);
+        std::ostringstream os{};
+        write_network_function(os, zero);
+        if (zero.numerator != determinant_diagram::zero || zero.evaluate({ 0.0, 1.0 }) != 0.0 ||
+            os.str().find("numerator: 0\n") == std::string::npos) {
+            throw std::runtime_error{"network function of a shorted output is not zero"};
+        }
+
+        const auto rlc = parse("E1 0 2 1\nR1 0 1 1k\nC1 1 2 1u\nL1 1 3 1m\nR2 3 2 50\nI1 1 3 1\n");
+        const std::vector<double> frequencies{ 10.0, 1e3, 1e5 };
+        const mna_layout layout{rlc};
+        thread_pool pool{1};
+        for (const auto output : { std::size_t{0}, std::size_t{1}, std::size_t{2} }) {
+            // the sweep drives E1 and I1 together, so it is the sum of both transfer functions
+            const auto by_voltage = make_network_function(analysis{rlc}, "E1", output);
+            const auto by_current = make_network_function(analysis{rlc}, "I1", output);
+            ac_sweep(rlc, layout, frequencies, pool, [&] (const std::size_t i, const std::vector<std::complex<double>>& x) {
+                const std::complex<double> s{ 0.0, 2 * M_PI * frequencies[i] };
+                const auto expected = x[node_map{rlc}.compact(output)];
+                if (std::abs(by_voltage.evaluate(s) + by_current.evaluate(s) - expected) > 1e-9 * std::abs(expected)) {
+                    throw std::runtime_error{"network function disagrees with the AC solve"};
+                }
+            });
+        }
+    }
+
+    struct named_circuit {
+        std::string name;
+        circuit c;
+    };
+
+    std::vector<named_circuit> sparse_inputs(const options& opts) {
+        const auto ladder = scaled(opts, 100000), side = scaled(opts, 300), nodes = scaled(opts, 50000);
+        const auto sources = scaled(opts, 50000);
+
+        return {
+            { "rc_ladder/" + std::to_string(ladder), generators::rc_ladder(ladder) },
+            { "resistor_grid/" + std::to_string(side) + "x" + std::to_string(side), generators::resistor_grid(side, side) },
+            { "random_sparse/" + std::to_string(nodes) + "x" + std::to_string(3 * nodes),
+                generators::random_sparse(nodes, 3 * nodes) },
+            { "many_sources/" + std::to_string(sources), generators::many_sources(sources) }
+        };
+    }
+
+    /// @return whether any of the benchmarks named is selected by the filter, so that its setup is needed
+    bool selected(const options& opts, std::initializer_list<const char*> names) {
+        return std::any_of(std::begin(names), std::end(names),
+            [&opts] (const char* const name) { return std::string{name}.find(opts.filter) != std::string::npos; });
+    }
+
+    void run_micro(const options& opts) {
+        if (selected(opts, { "circuit_from_stream", "to_incidence", "select_spanning_tree" })) {
+            const auto inputs = sparse_inputs(opts);
+
+            for (const auto& input : inputs) {
+                if (!selected(opts, { "circuit_from_stream" })) break;
+
+                std::ostringstream os{};
+                generators::write_netlist(os, input.c);
+                const auto text = os.str();
+
+                run(opts, "circuit_from_stream", input.name, input.c.size(), [&text] {
+                    keep(circuit_from_buffer(text.data(), text.data() + text.size()).size());
+                });
+            }
+
+            for (const auto& input : inputs) {
+                run(opts, "to_incidence", input.name, input.c.size(), [&input] { keep(to_incidence(input.c).nnz()); });
+                if (!selected(opts, { "select_spanning_tree" })) continue;
+
+                const auto normalized = normalize(input.c);
+                run(opts, "select_spanning_tree", input.name, input.c.size(), [&normalized] {
+                    keep(select_spanning_tree(normalized).size());
+                });
+            }
+        }
+
+        // dense kernels on the reduced incidence matrix A of a grid and on the node admittance pattern A * A^T
+        if (selected(opts, { "echelonize", "operator*", "invert" })) {
+            const auto side = scaled(opts, 20);
+            const auto grid = generators::resistor_grid(side, side);
+            const auto name = "resistor_grid/" + std::to_string(side) + "x" + std::to_string(side);
+            const auto incidence = to_dense_as<float>(reduce_last_row(to_incidence(grid)));
+            const auto incidence_transposed = transpose(incidence);
+            const auto laplacian = incidence * incidence_transposed;
+            const auto dense_items = incidence.row_num() * incidence.col_num();
+
+            run(opts, "echelonize", name, dense_items, [&incidence] { keep(echelonize(incidence).row_num()); });
+            run(opts, "operator*", name, dense_items, [&incidence, &incidence_transposed] {
+                keep((incidence * incidence_transposed).row_num());
+            });
+            run(opts, "invert", name, laplacian.row_num() * laplacian.col_num(), [&laplacian] {
+                keep(invert(laplacian).row_num());
+            });
+        }
+    }
+
+    void run_macro(const options& opts) {
+        if (selected(opts, { "analysis", "get_model_equations", "netlist_to_equations" })) {
+            for (const auto& input : sparse_inputs(opts)) {
+                run(opts, "analysis", input.name, input.c.size(), [&input] {
+                    keep(analysis{input.c}.get_loop_matrix().nnz());
+                });
+
+                if (selected(opts, { "get_model_equations" })) {
+                    const analysis nodal_analyzer{input.c};
+                    run(opts, "get_model_equations", input.name, input.c.size(), [&nodal_analyzer] {
+                        keep(nodal_analyzer.get_model_equations().equations.term_num());
+                    });
+                }
+
+                if (selected(opts, { "netlist_to_equations" })) {
+                    std::ostringstream os{};
+                    generators::write_netlist(os, input.c);
+                    const auto text = os.str();
+
+                    run(opts, "netlist_to_equations", input.name, input.c.size(), [&text] {
+                        null_buffer buffer{};
+                        std::ostream out{&buffer};
+                        write_model_equations(out, circuit_from_buffer(text.data(), text.data() + text.size()));
+                    });
+                }
+            }
+        }
+
+        // random_sparse has capacitor cut-sets and inductor loops, so it is left out of the DC solve
+        if (selected(opts, { "solve_dc", "sparse_lu_refactor" })) {
+            const auto ladder = scaled(opts, 1000000), side = scaled(opts, 300), sources = scaled(opts, 300000);
+            const std::vector<named_circuit> dc_inputs{
+                { "rc_ladder/" + std::to_string(ladder), generators::rc_ladder(ladder) },
+                { "resistor_grid/" + std::to_string(side) + "x" + std::to_string(side), generators::resistor_grid(side, side) },
+                { "many_sources/" + std::to_string(sources), generators::many_sources(sources) }
+            };
+            for (const auto& input : dc_inputs) {
+                const mna_layout layout{input.c};
+                run(opts, "solve_dc", input.name, layout.size(), [&input, &layout] { keep(solve_dc(input.c, layout).size()); });
+                if (!selected(opts, { "sparse_lu_refactor" })) continue;
+
+                // numeric refactorization with the pivot sequence kept, as done per frequency by ac_sweep
+                const auto system = assemble_dc(input.c, layout);
+                sparse_lu<double> lu{system.columns};
+                run(opts, "sparse_lu_refactor", input.name, layout.size(), [&system, &lu] { keep(lu.refactor(system.columns)); });
+            }
+        }
+
+        // edits of a grid applied incrementally against a full analysis of the edited grid
+        if (selected(opts, { "incremental_edit", "analysis" })) {
+            const auto edit_side = scaled(opts, 100);
+            const auto edit_grid = generators::resistor_grid(edit_side, edit_side);
+            const auto edit_name = "resistor_grid/" + std::to_string(edit_side) + "x" + std::to_string(edit_side);
+            if (selected(opts, { "incremental_edit" })) {
+                incremental_analysis edit_model{edit_grid};
+                const auto edit_num = scaled(opts, 1000);
+                run(opts, "incremental_edit", edit_name, 2 * edit_num, [&edit_model, edit_side, edit_num] {
+                    // add and remove a link between opposite grid nodes, so the model returns to its starting state
+                    for (const auto i : ext::range(0, edit_num)) {
+                        const auto node = i % (edit_side * edit_side);
+                        edit_model.add_element({ element_type::capacitor, node, edit_side * edit_side - 1 - node, "X", 1.0 });
+                        edit_model.remove_element("X");
+                    }
+                });
+            }
+            run(opts, "analysis", edit_name, edit_grid.size(), [&edit_grid] {
+                keep(analysis{edit_grid}.get_loop_matrix().nnz());
+            });
+        }
+
+        // symbolic network function of a ladder, the diagrams grow linearly with the sections
+        if (selected(opts, { "network_function" })) {
+            const auto ddd_sections = std::min<std::size_t>(scaled(opts, 30), 62);
+            const auto ddd_ladder = generators::rc_ladder(ddd_sections);
+            run(opts, "network_function", "rc_ladder/" + std::to_string(ddd_sections), ddd_ladder.size(), [&ddd_ladder, ddd_sections] {
+                keep(make_network_function(analysis{ddd_ladder}, "E0", ddd_sections - 1).diagram.size());
+            });
+        }
+
+        // step response over 100 time constants of a unit section, output every time constant
+        if (selected(opts, { "transient" })) {
+            const auto sections = scaled(opts, 100000);
+            const auto ladder_circuit = generators::rc_ladder(sections);
+            const mna_layout ladder_layout{ladder_circuit};
+            run(opts, "transient", "rc_ladder/" + std::to_string(sections), ladder_layout.size(),
+                [&ladder_circuit, &ladder_layout] {
+                    transient_simulation simulation{ladder_circuit, ladder_layout, make_transient_options(1.0, 100.0)};
+                    simulation.run([] (double, const std::vector<double>& x) { keep(x.size()); });
+                });
+        }
+    }
+}
+
+int main(int argc, char** argv) try {
+    options opts{ {}, 0.25, 1.0 };
+    instrumentation::set_storage_hooks(&storage_tracking);
+    auto check = false;
+    for (int arg{1}; arg < argc; ++arg) {
+        const std::string option{argv[arg]};
+        if (option == "--check") {
+            check = true;
+            continue;
+        }
+        if (++arg >= argc) throw std::runtime_error{"expected value after " + option};
+
+        if (option == "--filter") opts.filter = argv[arg];
+        else if (option == "--min-time") opts.min_time = std::stod(argv[arg]);
+        else if (option == "--scale") opts.scale = std::stod(argv[arg]);
+        else throw std::runtime_error{"unknown option " + option};
+    }
+
+    // correctness checks of the incremental analysis and the network functions instead of timings
+    if (check) {
+        check_incremental_edits(12, 400);
+        check_network_functions();
+        std::cout << "all checks passed" << std::endl;
+        return 0;
+    }
+
+    run_micro(opts);
+    run_macro(opts);
+} catch (const std::exception& e) {
+    std::cerr << "exception of type " << typeid(e).name() << ": " << e.what() << std::endl;
+    return 1;
+}
@@ -1,35 +1,162 @@
 #pragma once
 
 #include "element.hpp"
+#include "range.hpp"
 #include <vector>
+#include <string>
+#include <initializer_list>
 #include <algorithm>
-#include <numeric>
 #include <ostream>
+#include <stdexcept>
+#include <cstdint>
 #include <cstddef>
 
-using circuit = std::vector<element>;
+/** \brief list of circuit elements stored as a structure of arrays
+    Types, tails, heads and values live in separate packed arrays so that topology passes only touch
+    the data they need. Names are kept back to back in a single character pool, each element refers
+    to its name by offset and length, hence reordering elements never moves any characters.
+*/
+class circuit {
+public:
+    circuit() = default;
+    circuit(std::initializer_list<element> elements) {
+        reserve(elements.size(), 0);
+        for (const auto& el : elements) push_back(el);
+    }
+
+    std::size_t size() const { return types.size(); }
+    bool empty() const { return types.empty(); }
+
+    void reserve(const std::size_t element_num, const std::size_t name_pool_size) {
+        types.reserve(element_num);
+        tails.reserve(element_num);
+        heads.reserve(element_num);
+        values.reserve(element_num);
+        name_offsets.reserve(element_num);
+        name_lengths.reserve(element_num);
+        name_pool.reserve(name_pool_size);
+    }
+
+    void push_back(const element_type type, const std::size_t tail, const std::size_t head,
+                   const char* const name, const std::size_t name_length, const double value = 0.0) {
+        types.push_back(type);
+        tails.push_back(tail);
+        heads.push_back(head);
+        values.push_back(value);
+        name_offsets.push_back(name_pool.size());
+        name_lengths.push_back(static_cast<std::uint32_t>(name_length));
+        name_pool.append(name, name_length);
+    }
+
+    void push_back(const element& el) { push_back(el.type, el.tail, el.head, el.name.data(), el.name.size(), el.value); }
+
+    /// @brief copies the elements of `other` to the end of this circuit
+    void append(const circuit& other) {
+        const auto pool_offset = name_pool.size();
+        types.insert(std::end(types), std::begin(other.types), std::end(other.types));
+        tails.insert(std::end(tails), std::begin(other.tails), std::end(other.tails));
+        heads.insert(std::end(heads), std::begin(other.heads), std::end(other.heads));
+        values.insert(std::end(values), std::begin(other.values), std::end(other.values));
+        for (const auto offset : other.name_offsets) name_offsets.push_back(pool_offset + offset);
+        name_lengths.insert(std::end(name_lengths), std::begin(other.name_lengths), std::end(other.name_lengths));
+        name_pool.append(other.name_pool);
+    }
+
+    element_type type(const std::size_t i) const { return types[i]; }
+    std::size_t tail(const std::size_t i) const { return tails[i]; }
+    std::size_t head(const std::size_t i) const { return heads[i]; }
+    double value(const std::size_t i) const { return values[i]; }
+    const char* name_data(const std::size_t i) const { return name_pool.data() + name_offsets[i]; }
+    std::size_t name_length(const std::size_t i) const { return name_lengths[i]; }
+    std::string name(const std::size_t i) const { return { name_data(i), name_length(i) }; }
+
+    bool is_voltage_defined(const std::size_t i) const { return ::is_voltage_defined(types[i]); }
+    bool is_current_defined(const std::size_t i) const { return ::is_current_defined(types[i]); }
+    bool is_source(const std::size_t i) const { return ::is_source(types[i]); }
+
+    /// @brief element i by value, meant for code outside of the analysis loops
+    element operator[](const std::size_t i) const { return { types[i], tails[i], heads[i], name(i), values[i] }; }
+
+    const std::vector<element_type>& get_types() const { return types; }
+    const std::vector<std::size_t>& get_tails() const { return tails; }
+    const std::vector<std::size_t>& get_heads() const { return heads; }
+    const std::vector<double>& get_values() const { return values; }
+
+    void set_nodes(const std::size_t i, const std::size_t tail, const std::size_t head) {
+        tails[i] = tail;
+        heads[i] = head;
+    }
+
+    void set_value(const std::size_t i, const double value) { values[i] = value; }
+
+    /// @return circuit whose element i is element order[i] of this one, the name pool is copied unchanged so offsets stay valid
+    circuit permute(const std::vector<std::size_t>& order) const {
+        if (order.size() != size()) throw std::logic_error{"permutation size does not match the circuit"};
+
+        circuit result{};
+        result.types.reserve(size());
+        result.tails.reserve(size());
+        result.heads.reserve(size());
+        result.values.reserve(size());
+        result.name_offsets.reserve(size());
+        result.name_lengths.reserve(size());
+        for (const auto i : order) {
+            result.types.push_back(types[i]);
+            result.tails.push_back(tails[i]);
+            result.heads.push_back(heads[i]);
+            result.values.push_back(values[i]);
+            result.name_offsets.push_back(name_offsets[i]);
+            result.name_lengths.push_back(name_lengths[i]);
+        }
+        result.name_pool = name_pool;
+
+        return result;
+    }
+
+private:
+    std::vector<element_type> types;
+    std::vector<std::size_t> tails;
+    std::vector<std::size_t> heads;
+    std::vector<double> values;
+    std::vector<std::size_t> name_offsets;
+    std::vector<std::uint32_t> name_lengths;
+    std::string name_pool;
+};
 
 std::ostream& operator<<(std::ostream& os, const circuit& c) {
     os << "{\n";
-    for (const auto& el : c) {
+    for (const auto i : ext::range(0, c.size())) {
         os << "\t{ " <<
-            to_string(el.type) << ", " <<
-            el.tail << ", " <<
-            el.head << ", " <<
-            el.name << " }\n";
+            to_string(c.type(i)) << ", " <<
+            c.tail(i) << ", " <<
+            c.head(i) << ", ";
+        os.write(c.name_data(i), c.name_length(i)) << ", " << c.value(i) << " }\n";
     }
 
     return os << '}' << std::endl;
 }
 
 inline std::size_t count_nodes(const circuit& c) {
-   return std::accumulate(std::begin(c), std::end(c), std::size_t{},
-        [] (const std::size_t node_max, const element& el) {
-        return std::max(node_max, std::max(el.tail, el.head));
-    }) + 1;
+    const auto& tails = c.get_tails();
+    const auto& heads = c.get_heads();
+
+    std::size_t node_max{};
+    for (const auto i : ext::range(0, c.size())) node_max = std::max(node_max, std::max(tails[i], heads[i]));
+
+    return node_max + 1;
 }
 
-circuit normalize(circuit c) {
-    std::sort(std::begin(c), std::end(c));
-    return c;
+/// @return element order of normalize(), the permutation std::sort applies to the elements by type
+std::vector<std::size_t> normalized_order(const circuit& c) {
+    const auto& types = c.get_types();
+
+    std::vector<std::size_t> order(c.size());
+    for (const auto i : ext::range(0, c.size())) order[i] = i;
+    std::sort(std::begin(order), std::end(order),
+        [&types] (const std::size_t lhs, const std::size_t rhs) { return types[lhs] < types[rhs]; });
+
+    return order;
 }
+
+/// @brief orders elements by type, see normalized_order
+circuit normalize(const circuit& c) { return c.permute(normalized_order(c)); }
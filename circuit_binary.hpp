@@ -0,0 +1,182 @@
+#pragma once
+
+#include "circuit.hpp"
+#include "range.hpp"
+#include "symbol_table.hpp"
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+/** \brief versioned binary circuit format
+    header      magic "CIRCTOPO", version, byte order mark, element count, string pool size
+    elements    one packed record per element: tail, head, name offset and length, type, value
+    pool        element names back to back, without terminators
+    All fields use the byte order of the writing machine, the mark lets readers reject foreign files.
+    Version 1 files, whose records have no value, are still read with every value set to 0.
+*/
+namespace circuit_binary {
+    const char magic[8]{ 'C', 'I', 'R', 'C', 'T', 'O', 'P', 'O' };
+    const std::uint32_t version{2};
+    const std::uint32_t byte_order_mark{0x01020304};
+
+    struct header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint64_t element_num;
+        std::uint64_t pool_size;
+    };
+
+    struct record {
+        std::uint64_t tail;
+        std::uint64_t head;
+        std::uint64_t name_offset;
+        std::uint32_t name_length;
+        std::uint8_t type;
+        std::uint8_t padding[3];
+        double value;
+    };
+
+    /// @brief version 1 record, i.e. a record without its value
+    const std::size_t record_v1_size{32};
+
+    static_assert(sizeof(header) == 32 && sizeof(record) == 40, "unexpected padding in circuit_binary structures");
+
+    inline std::uint32_t swap_bytes(const std::uint32_t x) {
+        return (x >> 24) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+    }
+
+    /** \brief tells a binary circuit from a text netlist
+        The magic alone is printable and may start a netlist, e.g. one whose first element is named CIRCTOPO1,
+        so the byte order mark and a known version, in either byte order, have to follow it as well.
+    */
+    inline bool has_header(const char* const first, const char* const last) {
+        if (static_cast<std::size_t>(last - first) < sizeof(header) || std::memcmp(first, magic, sizeof(magic)) != 0) return false;
+
+        header h;
+        std::memcpy(&h, first, sizeof(h));
+        if (h.byte_order == swap_bytes(byte_order_mark)) h.version = swap_bytes(h.version);
+        else if (h.byte_order != byte_order_mark) return false;
+
+        return h.version == version || h.version == 1;
+    }
+} /* namespace circuit_binary */
+
+void circuit_to_binary(std::ostream& os, const circuit& c) {
+    using namespace circuit_binary;
+
+    std::uint64_t pool_size{};
+    for (const auto i : ext::range(0, c.size())) pool_size += c.name_length(i);
+
+    header h{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.byte_order = byte_order_mark;
+    h.element_num = c.size();
+    h.pool_size = pool_size;
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    std::vector<record> records(c.size());
+    std::uint64_t offset{};
+    for (const auto i : ext::range(0, c.size())) {
+        records[i].tail = c.tail(i);
+        records[i].head = c.head(i);
+        records[i].name_offset = offset;
+        records[i].name_length = static_cast<std::uint32_t>(c.name_length(i));
+        records[i].type = static_cast<std::uint8_t>(c.type(i));
+        records[i].value = c.value(i);
+        offset += c.name_length(i);
+    }
+    os.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(record));
+
+    for (const auto i : ext::range(0, c.size())) os.write(c.name_data(i), c.name_length(i));
+
+    if (!os) throw std::runtime_error{"could not write binary circuit"};
+}
+
+/** \brief zero-copy view of a binary circuit held in memory, e.g. a mapped file
+    The buffer is validated once on construction, accessors then read it in place.
+*/
+class circuit_binary_view {
+public:
+    circuit_binary_view(const char* const first, const char* const last) {
+        using namespace circuit_binary;
+
+        const auto size = static_cast<std::size_t>(last - first);
+        if (size < sizeof(header) || std::memcmp(first, magic, sizeof(magic)) != 0) throw std::runtime_error{"not a binary circuit"};
+
+        header h;
+        std::memcpy(&h, first, sizeof(h));
+        if (h.byte_order != byte_order_mark) throw std::runtime_error{"binary circuit has foreign byte order"};
+        if (h.version != version && h.version != 1) {
+            throw std::runtime_error{"unsupported binary circuit version " + std::to_string(h.version)};
+        }
+
+        record_size = h.version == 1 ? record_v1_size : sizeof(record);
+        if (h.element_num > (size - sizeof(header)) / record_size ||
+            h.pool_size != size - sizeof(header) - h.element_num * record_size) {
+            throw std::runtime_error{"truncated or oversized binary circuit"};
+        }
+
+        element_num = h.element_num;
+        records = first + sizeof(header);
+        pool = records + element_num * record_size;
+
+        for (const auto i : ext::range(0, element_num)) {
+            const auto r = get(i);
+            if (r.type > static_cast<std::uint8_t>(element_type::current_source)) {
+                throw std::runtime_error{"invalid element type in binary circuit record " + std::to_string(i)};
+            }
+            if (r.name_offset > h.pool_size || r.name_length > h.pool_size - r.name_offset) {
+                throw std::runtime_error{"invalid element name in binary circuit record " + std::to_string(i)};
+            }
+        }
+    }
+
+    std::size_t size() const { return element_num; }
+
+    element_type type(const std::size_t i) const { return static_cast<element_type>(get(i).type); }
+    std::size_t tail(const std::size_t i) const { return get(i).tail; }
+    std::size_t head(const std::size_t i) const { return get(i).head; }
+    const char* name_data(const std::size_t i) const { return pool + get(i).name_offset; }
+    std::size_t name_length(const std::size_t i) const { return get(i).name_length; }
+    double value(const std::size_t i) const { return get(i).value; }
+
+private:
+    circuit_binary::record get(const std::size_t i) const {
+        circuit_binary::record result{};
+        std::memcpy(&result, records + i * record_size, record_size);
+        return result;
+    }
+
+    std::size_t element_num;
+    std::size_t record_size;
+    const char* records;
+    const char* pool;
+};
+
+circuit circuit_from_binary(const char* const first, const char* const last) {
+    const circuit_binary_view view{first, last};
+
+    // the same check as for text netlists, names are looked up in place in the pool
+    name_set names{view.size()};
+    for (const auto i : ext::range(0, view.size())) {
+        const name_ref name{ view.name_data(i), view.name_length(i), hash_bytes(view.name_data(i), view.name_length(i)) };
+        if (!names.insert(name)) {
+            throw std::runtime_error{"duplicate element name " + std::string{name.data, name.length} +
+                " in binary circuit record " + std::to_string(i)};
+        }
+    }
+
+    circuit result{};
+    result.reserve(view.size(), static_cast<std::size_t>(last - first));
+    for (const auto i : ext::range(0, view.size())) {
+        result.push_back(view.type(i), view.tail(i), view.head(i), view.name_data(i), view.name_length(i), view.value(i));
+    }
+
+    return result;
+}
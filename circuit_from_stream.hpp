@@ -1,51 +1,306 @@
 #pragma once
 
 #include "circuit.hpp"
-#include <sstream>
-#include <unordered_map>
-#include <unordered_set>
+#include "circuit_binary.hpp"
+#include "mapped_file.hpp"
+#include "symbol_table.hpp"
+#include "thread_pool.hpp"
+#include <istream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
+#include <cstring>
+#include <cstdlib>
 
-circuit circuit_from_stream(std::istream& is) {
-    circuit result{};
+namespace {
+    /// @brief whitespace as skipped by operator>>, newlines never occur within a line
+    inline bool is_space(const char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+
+    inline bool char_to_element_type(const char c, element_type& type) {
+        switch (c) {
+        case 'E': type = element_type::voltage_source; return true;
+        case 'C': type = element_type::capacitor; return true;
+        case 'R': type = element_type::resistor; return true;
+        case 'L': type = element_type::inductor; return true;
+        case 'I': type = element_type::current_source; return true;
+        default: return false;
+        }
+    }
+
+    /// @brief skips whitespace and reads an unsigned decimal number, fails on a missing number or overflow
+    inline bool parse_node(const char*& it, const char* const last, std::size_t& value) {
+        while (it != last && is_space(*it)) ++it;
+        if (it != last && *it == '+') ++it;
+        if (it == last || !is_digit(*it)) return false;
+
+        const auto max = std::numeric_limits<std::size_t>::max();
+        value = 0;
+        for (; it != last && is_digit(*it); ++it) {
+            const std::size_t digit = *it - '0';
+            if (value > (max - digit) / 10) return false;
+            value = value * 10 + digit;
+        }
+
+        return true;
+    }
+
+    /** \brief skips whitespace and reads an optional element value such as 4.7, 1e-9 or 10k
+        SPICE scale suffixes f, p, n, u, m, k, meg, g and t are understood, any letters following them
+        are ignored. A missing or non-numeric field leaves `value` at 0, as anything after the nodes
+        used to be ignored.
+    */
+    inline void parse_value(const char*& it, const char* const last, double& value) {
+        value = 0.0;
+        while (it != last && is_space(*it)) ++it;
+
+        const auto first = it;
+        while (it != last && !is_space(*it)) ++it;
+
+        // strtod needs a terminated string and the buffer may end right after the field
+        char token[64];
+        const auto length = std::min(static_cast<std::size_t>(it - first), sizeof(token) - 1);
+        std::memcpy(token, first, length);
+        token[length] = '\0';
+
+        char* suffix{};
+        const auto number = std::strtod(token, &suffix);
+        if (suffix == token) return;
+
+        const auto lower = [] (const char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); };
+        auto scale = 1.0;
+        switch (lower(*suffix)) {
+        case 'f': scale = 1e-15; break;
+        case 'p': scale = 1e-12; break;
+        case 'n': scale = 1e-9; break;
+        case 'u': scale = 1e-6; break;
+        case 'm': scale = lower(suffix[1]) == 'e' && lower(suffix[2]) == 'g' ? 1e6 : 1e-3; break;
+        case 'k': scale = 1e3; break;
+        case 'g': scale = 1e9; break;
+        case 't': scale = 1e12; break;
+        }
 
-    static const std::unordered_map<char, element_type> char_to_element_type{
-        { 'E', element_type::voltage_source },
-        { 'C', element_type::capacitor },
-        { 'R', element_type::resistor },
-        { 'L', element_type::inductor },
-        { 'I', element_type::current_source }
+        value = number * scale;
+    }
+
+    inline std::size_t count_lines(const char* first, const char* const last) {
+        std::size_t result{1};
+        while (const auto newline = static_cast<const char*>(std::memchr(first, '\n', last - first))) {
+            ++result;
+            first = newline + 1;
+        }
+
+        return result;
+    }
+
+    enum struct line_error { none, no_name, unknown_element, no_nodes };
+
+    /// @brief element fields parsed from a line, its name stays in the buffer
+    struct parsed_element {
+        element_type type;
+        std::size_t tail;
+        std::size_t head;
+        double value;
     };
 
-    std::unordered_set<std::string> element_names{};
+    /// @brief parses a single line, `name` is set whenever the line has one, even if parsing fails later on
+    inline line_error parse_line(const char* it, const char* const line_end, parsed_element& el, name_ref& name) {
+        while (it != line_end && is_space(*it)) ++it;
+        name.data = it;
+        while (it != line_end && !is_space(*it)) ++it;
+        name.length = it - name.data;
+
+        if (name.length == 0) return line_error::no_name;
+        name.hash = hash_bytes(name.data, name.length);
+
+        if (!char_to_element_type(*name.data, el.type)) return line_error::unknown_element;
+        if (!parse_node(it, line_end, el.tail) || !parse_node(it, line_end, el.head)) return line_error::no_nodes;
+        parse_value(it, line_end, el.value);
 
-    std::string str{};
-    for (std::size_t line_num = 1; std::getline(is, str); ++line_num) {
-        std::istringstream in{str};
+        return line_error::none;
+    }
 
-        std::string name;
-        if (!(in >> name)) {
-            throw std::runtime_error{"expected element name at line " + std::to_string(line_num)};
+    std::runtime_error make_line_error(const line_error error, const name_ref& name, const std::size_t line_num) {
+        switch (error) {
+        case line_error::no_name:
+            return std::runtime_error{"expected element name at line " + std::to_string(line_num)};
+        case line_error::unknown_element:
+            return std::runtime_error{"unknown element " + std::string{name.data, name.length} + " at line " + std::to_string(line_num)};
+        case line_error::no_nodes:
+            return std::runtime_error{"expected element tail and head node numbers at line " + std::to_string(line_num)};
+        case line_error::none: break;
         }
 
-        if (element_names.count(name) != 0) {
-            throw std::runtime_error{"duplicate element name " + name + " at line " + std::to_string(line_num)};
+        throw std::logic_error{"invalid line_error value"};
+    }
+
+    std::runtime_error make_duplicate_error(const name_ref& name, const std::size_t line_num) {
+        return std::runtime_error{"duplicate element name " + std::string{name.data, name.length} + " at line " + std::to_string(line_num)};
+    }
+
+    /// @brief a newline-aligned part of a netlist parsed independently of the others
+    struct netlist_chunk {
+        const char* first;
+        const char* last;
+        circuit elements;
+        /// names of the parsed elements, followed by the name of the failing line if it has one
+        std::vector<name_ref> names;
+        /// error on line elements.size() + 1 of the chunk, if any
+        line_error error;
+    };
+
+    inline void parse_chunk(netlist_chunk& chunk) {
+        chunk.error = line_error::none;
+
+        parsed_element el{};
+        name_ref name{};
+        for (auto line = chunk.first; line != chunk.last; ) {
+            const auto newline = static_cast<const char*>(std::memchr(line, '\n', chunk.last - line));
+            const auto line_end = newline ? newline : chunk.last;
+
+            chunk.error = parse_line(line, line_end, el, name);
+            if (chunk.error != line_error::no_name) chunk.names.push_back(name);
+            if (chunk.error != line_error::none) return;
+
+            chunk.elements.push_back(el.type, el.tail, el.head, name.data, name.length, el.value);
+            line = newline ? newline + 1 : chunk.last;
         }
+    }
+}
+
+/** \brief parses a netlist held in memory, one element per line: name, tail node, head node, value
+    The first letter of the name selects the element type. The value is optional, see parse_value,
+    anything after it is ignored.
+*/
+circuit circuit_from_buffer(const char* const first, const char* const last) {
+    circuit result{};
+    if (first == last) return result;
+
+    const auto line_count = count_lines(first, last);
+    result.reserve(line_count, static_cast<std::size_t>(last - first));
+    name_set element_names{line_count};
+
+    parsed_element el{};
+    name_ref name{};
+    std::size_t line_num{1};
+    for (auto line = first; line != last; ++line_num) {
+        const auto newline = static_cast<const char*>(std::memchr(line, '\n', last - line));
+        const auto line_end = newline ? newline : last;
+
+        const auto error = parse_line(line, line_end, el, name);
+        if (error == line_error::no_name) throw make_line_error(error, name, line_num);
+        if (!element_names.insert(name)) throw make_duplicate_error(name, line_num);
+        if (error != line_error::none) throw make_line_error(error, name, line_num);
+
+        result.push_back(el.type, el.tail, el.head, name.data, name.length, el.value);
+        line = newline ? newline + 1 : last;
+    }
+
+    return result;
+}
+
+/** \brief parses a netlist held in memory on a thread pool
+    The buffer is split into newline-aligned chunks parsed concurrently. Duplicate names are then
+    detected by one task per hash shard. Every shard walks all names in file order, so the
+    reported error is always the one on the earliest line, exactly as with the sequential parser.
+    Buffers no larger than `min_chunk_size` are parsed sequentially.
+*/
+circuit circuit_from_buffer(const char* const first, const char* const last, thread_pool& pool,
+                            const std::size_t min_chunk_size = 1 << 20) {
+    const auto size = static_cast<std::size_t>(last - first);
+    const auto chunk_size = std::max(min_chunk_size, size / (4 * pool.size()) + 1);
+    if (size <= chunk_size) return circuit_from_buffer(first, last);
 
-        const auto it = char_to_element_type.find(name[0]);
-        if (it == std::end(char_to_element_type)) {
-            throw std::runtime_error{"unknown element " + name + " at line " + std::to_string(line_num)};
+    std::vector<netlist_chunk> chunks{};
+    for (auto chunk_first = first; chunk_first != last; ) {
+        auto chunk_last = chunk_first + std::min(chunk_size, static_cast<std::size_t>(last - chunk_first));
+        if (chunk_last != last) {
+            const auto newline = static_cast<const char*>(std::memchr(chunk_last - 1, '\n', last - chunk_last + 1));
+            chunk_last = newline ? newline + 1 : last;
         }
-        const auto type = it->second;
 
-        std::size_t tail, head;
-        if (!(in >> tail >> head)) {
-            throw std::runtime_error{"expected element tail and head node numbers at line " + std::to_string(line_num)};
+        chunks.push_back({ chunk_first, chunk_last, {}, {}, line_error::none });
+        chunk_first = chunk_last;
+    }
+
+    parallel_for(pool, chunks.size(), [&chunks] (const std::size_t i) { parse_chunk(chunks[i]); });
+
+    // only chunks up to the first failing one matter, line numbers follow from the element counts
+    std::size_t chunk_num{}, name_num{};
+    std::vector<std::size_t> line_offsets{};
+    for (const auto& chunk : chunks) {
+        line_offsets.push_back(name_num);
+        name_num += chunk.elements.size();
+        ++chunk_num;
+        if (chunk.error != line_error::none) break;
+    }
+
+    const auto shard_num = pool.size();
+    std::vector<std::size_t> duplicate_lines(shard_num, 0);
+    parallel_for(pool, shard_num, [&] (const std::size_t shard) {
+        std::size_t shard_size{};
+        for (const auto i : ext::range(0, chunk_num)) {
+            for (const auto& name : chunks[i].names) shard_size += name.hash % shard_num == shard;
+        }
+
+        name_set names{shard_size};
+        for (const auto i : ext::range(0, chunk_num)) {
+            for (const auto index : ext::range(0, chunks[i].names.size())) {
+                const auto& name = chunks[i].names[index];
+                if (name.hash % shard_num == shard && !names.insert(name)) {
+                    duplicate_lines[shard] = line_offsets[i] + index + 1;
+                    return;
+                }
+            }
         }
+    });
 
-        result.push_back({ type, tail, head, name });
-        element_names.emplace(std::move(name));
+    std::size_t duplicate_line{};
+    for (const auto line : duplicate_lines) {
+        if (line != 0 && (duplicate_line == 0 || line < duplicate_line)) duplicate_line = line;
     }
 
+    const auto& last_chunk = chunks[chunk_num - 1];
+    if (duplicate_line != 0) {
+        std::size_t i{};
+        while (i + 1 < chunk_num && line_offsets[i + 1] < duplicate_line) ++i;
+        throw make_duplicate_error(chunks[i].names[duplicate_line - line_offsets[i] - 1], duplicate_line);
+    }
+    if (last_chunk.error != line_error::none) {
+        const auto line_num = line_offsets[chunk_num - 1] + last_chunk.elements.size() + 1;
+        throw make_line_error(last_chunk.error,
+            last_chunk.names.size() > last_chunk.elements.size() ? last_chunk.names.back() : name_ref{}, line_num);
+    }
+
+    circuit result{};
+    result.reserve(name_num, size);
+    for (const auto& chunk : chunks) result.append(chunk.elements);
+
     return result;
 }
+
+circuit circuit_from_stream(std::istream& is) {
+    const std::string buffer{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+    return circuit_from_buffer(buffer.data(), buffer.data() + buffer.size());
+}
+
+/// @brief memory-maps the file and reads it in place, binary circuits are recognized by their header
+circuit circuit_from_file(const std::string& path) {
+    const mapped_file file{path};
+    if (circuit_binary::has_header(file.begin(), file.end())) return circuit_from_binary(file.begin(), file.end());
+
+    return circuit_from_buffer(file.begin(), file.end());
+}
+
+circuit circuit_from_file(const std::string& path, thread_pool& pool) {
+    const mapped_file file{path};
+    if (circuit_binary::has_header(file.begin(), file.end())) return circuit_from_binary(file.begin(), file.end());
+
+    return circuit_from_buffer(file.begin(), file.end(), pool);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "circuit.hpp"
+#include "range.hpp"
+#include <string>
+#include <random>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+/** \brief parameterized synthetic circuits for benchmarks
+    Every circuit is connected, names follow the netlist convention of a type letter followed by a
+    number and the ground node gets the highest number, so it becomes the reference node. Every element
+    has the unit value.
+*/
+namespace generators {
+    namespace {
+        inline void add(circuit& c, const element_type type, const std::size_t tail, const std::size_t head,
+                        const std::size_t index) {
+            static const char letters[]{ 'E', 'C', 'R', 'L', 'I' };
+
+            const auto name = letters[static_cast<std::size_t>(type)] + std::to_string(index);
+            c.push_back(type, tail, head, name.data(), name.size(), 1.0);
+        }
+    }
+
+    /// @brief source driving a chain of `section_num` series resistors, each followed by a capacitor to ground
+    inline circuit rc_ladder(const std::size_t section_num) {
+        const auto ground = section_num;
+
+        circuit result{};
+        result.reserve(2 * section_num + 1, 8 * (2 * section_num + 1));
+        add(result, element_type::voltage_source, 0, ground, 0);
+        for (const auto i : ext::range(0, section_num)) {
+            add(result, element_type::resistor, i, i + 1 < section_num ? i + 1 : ground, i);
+            add(result, element_type::capacitor, i, ground, i);
+        }
+
+        return result;
+    }
+
+    /// @brief `rows` x `cols` resistor mesh fed by a voltage source at one corner and loaded by a current source at the other
+    inline circuit resistor_grid(const std::size_t rows, const std::size_t cols) {
+        const auto ground = rows * cols;
+        const auto node = [cols] (const std::size_t row, const std::size_t col) { return row * cols + col; };
+
+        circuit result{};
+        result.reserve(2 * rows * cols + 2, 8 * (2 * rows * cols + 2));
+        add(result, element_type::voltage_source, node(0, 0), ground, 0);
+        add(result, element_type::current_source, node(rows - 1, cols - 1), ground, 0);
+
+        std::size_t index{};
+        for (const auto row : ext::range(0, rows)) {
+            for (const auto col : ext::range(0, cols)) {
+                if (col + 1 < cols) add(result, element_type::resistor, node(row, col), node(row, col + 1), index++);
+                if (row + 1 < rows) add(result, element_type::resistor, node(row, col), node(row + 1, col), index++);
+            }
+        }
+
+        return result;
+    }
+
+    /** \brief random connected graph with `node_num` nodes and `branch_num` >= node_num - 1 branches
+        A random tree is laid first, the remaining branches join random pairs of distinct nodes. About one
+        branch in twenty is a source, the others are split evenly between resistors, capacitors and inductors.
+    */
+    inline circuit random_sparse(const std::size_t node_num, const std::size_t branch_num, const std::uint32_t seed = 1) {
+        std::mt19937 engine{seed};
+        const auto random_node = [&engine] (const std::size_t bound) {
+            return std::uniform_int_distribution<std::size_t>{0, bound - 1}(engine);
+        };
+        const auto random_type = [&engine] {
+            const auto roll = std::uniform_int_distribution<int>{0, 59}(engine);
+            return roll < 2 ? element_type::voltage_source : roll < 3 ? element_type::current_source
+                : roll < 22 ? element_type::resistor : roll < 41 ? element_type::capacitor : element_type::inductor;
+        };
+
+        circuit result{};
+        result.reserve(branch_num, 8 * branch_num);
+        std::size_t counts[element_traits::type_num]{};
+        const auto add_random = [&] (const std::size_t tail, const std::size_t head) {
+            const auto type = random_type();
+            add(result, type, tail, head, counts[element_traits::index(type)]++);
+        };
+
+        for (const auto node : ext::range(1, node_num)) add_random(random_node(node), node);
+        while (result.size() < branch_num && node_num > 1) {
+            const auto tail = random_node(node_num), head = random_node(node_num);
+            if (tail != head) add_random(tail, head);
+        }
+
+        return result;
+    }
+
+    /// @brief `source_num` voltage sources to ground chained by resistors, each node also fed by a current source
+    inline circuit many_sources(const std::size_t source_num) {
+        const auto ground = source_num;
+
+        circuit result{};
+        result.reserve(3 * source_num, 8 * 3 * source_num);
+        for (const auto i : ext::range(0, source_num)) {
+            add(result, element_type::voltage_source, i, ground, i);
+            add(result, element_type::current_source, ground, i, i);
+            if (i + 1 < source_num) add(result, element_type::resistor, i, i + 1, i);
+        }
+
+        return result;
+    }
+
+    /// @brief writes a circuit in the text netlist format read by circuit_from_stream
+    inline void write_netlist(std::ostream& os, const circuit& c) {
+        for (const auto i : ext::range(0, c.size())) {
+            os.write(c.name_data(i), c.name_length(i)) << ' ' << c.tail(i) << ' ' << c.head(i) << ' ' << c.value(i) << '\n';
+        }
+    }
+} /* namespace generators */
@@ -0,0 +1,530 @@
+#pragma once
+
+#include "analysis.hpp"
+#include "circuit.hpp"
+#include "sparse_matrix.hpp"
+#include "sparse_lu.hpp"
+#include "range.hpp"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <complex>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+/// @brief coefficient times the admittance of a branch, or just the coefficient for branch none
+struct symbolic_term {
+    std::size_t branch;
+    int coefficient;
+};
+
+/** \brief square matrix whose entries are sums of symbolic terms
+    Terms of the same branch are merged as they are added, entries are kept ordered by row and column.
+*/
+class symbolic_matrix {
+public:
+    enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+    explicit symbolic_matrix(const std::size_t size) : n{size} {}
+
+    std::size_t size() const { return n; }
+
+    void add(const std::size_t row, const std::size_t col, const symbolic_term term) {
+        if (row >= n || col >= n) throw std::out_of_range{"symbolic matrix entry out of bounds"};
+        if (term.coefficient == 0) return;
+
+        auto& terms = entries[{ row, col }];
+        const auto it = std::find_if(std::begin(terms), std::end(terms),
+            [&term] (const symbolic_term& t) { return t.branch == term.branch; });
+        if (it == std::end(terms)) terms.push_back(term);
+        else if ((it->coefficient += term.coefficient) == 0) terms.erase(it);
+
+        if (terms.empty()) entries.erase({ row, col });
+    }
+
+    /// @brief removes every entry of a column, e.g. to replace it by a right-hand side for Cramer's rule
+    void clear_column(const std::size_t col) {
+        for (auto it = std::begin(entries); it != std::end(entries); ) {
+            if (it->first.second == col) it = entries.erase(it);
+            else ++it;
+        }
+    }
+
+    const std::map<std::pair<std::size_t, std::size_t>, std::vector<symbolic_term>>& get_entries() const {
+        return entries;
+    }
+
+private:
+    std::size_t n;
+    std::map<std::pair<std::size_t, std::size_t>, std::vector<symbolic_term>> entries;
+};
+
+/** \brief determinant decision diagrams (Shi and Tan) sharing their vertices
+    A vertex stands for coefficient * y_branch * D(then) + D(else), y_branch being the admittance of
+    the branch, or 1 for a constant, so every path to the one terminal along then edges is a product
+    term of the determinant. Vertices are hash-consed: equal subexpressions of any diagram built by
+    the same instance are the same vertex. Children are always created before their parents, so
+    vertex numbers are a topological order.
+*/
+class determinant_diagram {
+public:
+    using node = std::uint32_t;
+    enum : node { zero = 0, one = 1 };
+
+    struct vertex {
+        std::size_t branch;
+        int coefficient;
+        node then_node;
+        node else_node;
+    };
+
+    determinant_diagram() : vertices{ { symbolic_matrix::none, 0, zero, zero }, { symbolic_matrix::none, 1, one, one } } {}
+
+    /** \brief diagram of the determinant of `m`
+        The determinant is expanded entry by entry, det M = s a_ij det M(i, j) + det M|a_ij=0 with the
+        sign s of the position of a_ij within the remaining rows and columns, and every term of a_ij
+        shares the cofactor. Submatrices are identified by their remaining rows and columns and the
+        next entry to expand, so each one is expanded once. The entries are ordered by a minimum
+        degree ordering of the rows and columns, as Markowitz ordering would take them, which keeps
+        the cofactors few and shared. Matrices are limited to 64 rows.
+    */
+    node build(const symbolic_matrix& m) {
+        if (m.size() > 64) throw std::runtime_error{"determinant diagrams support up to 64 rows"};
+        if (m.size() == 0) return one;
+
+        return expansion{*this, m}.run();
+    }
+
+    std::size_t size() const { return vertices.size(); }
+    const vertex& operator[](const node v) const { return vertices[v]; }
+
+    /// @return number of vertices reachable from `root`, terminals excluded
+    std::size_t size(const node root) const {
+        if (root <= one) return 0;
+
+        std::vector<bool> reached(root + 1);
+        reached[root] = true;
+        std::size_t result{};
+        for (const auto v : ext::reverse_range(2, root + 1)) {
+            if (!reached[v]) continue;
+
+            ++result;
+            reached[vertices[v].then_node] = reached[vertices[v].else_node] = true;
+        }
+
+        return result;
+    }
+
+    /// @return number of paths from `root` to the one terminal, i.e. of product terms before cancellation
+    double path_num(const node root) const {
+        if (root <= one) return root;
+
+        std::vector<double> counts(root + 1);
+        counts[one] = 1;
+        for (const auto v : ext::range(2, root + 1)) counts[v] = counts[vertices[v].then_node] + counts[vertices[v].else_node];
+
+        return counts[root];
+    }
+
+    /// @return value of the diagram, `admittance(branch)` giving the value of y_branch
+    template<typename Value, typename Admittance> Value evaluate(const node root, Admittance admittance) const {
+        if (root <= one) return Value{static_cast<double>(root)};
+
+        std::vector<Value> values(root + 1);
+        values[one] = Value{1};
+        for (const auto v : ext::range(2, root + 1)) {
+            const auto& x = vertices[v];
+            auto product = static_cast<Value>(static_cast<double>(x.coefficient)) * values[x.then_node];
+            if (x.branch != symbolic_matrix::none) product *= admittance(x.branch);
+            values[v] = product + values[x.else_node];
+        }
+
+        return values[root];
+    }
+
+    /** \brief the product terms of the diagram, each as its sorted branches and its coefficient
+        Terms with equal branches are merged and those cancelling out dropped, hence the result is the
+        sum of products of the polynomial, e.g. the spanning tree products of a nodal determinant.
+        The diagram itself may hold cancelling terms, the number of paths being exponential at worst.
+    */
+    std::map<std::vector<std::size_t>, long long> sum_of_products(const node root) const {
+        std::map<std::vector<std::size_t>, long long> result{};
+        std::vector<std::size_t> branches{};
+
+        const std::function<void(node, long long)> visit = [&] (const node v, const long long coefficient) {
+            if (v == zero) return;
+            if (v == one) {
+                auto key = branches;
+                std::sort(std::begin(key), std::end(key));
+                if ((result[key] += coefficient) == 0) result.erase(key);
+                return;
+            }
+
+            const auto& x = vertices[v];
+            if (x.branch != symbolic_matrix::none) branches.push_back(x.branch);
+            visit(x.then_node, coefficient * x.coefficient);
+            if (x.branch != symbolic_matrix::none) branches.pop_back();
+
+            visit(x.else_node, coefficient);
+        };
+        visit(root, 1);
+
+        return result;
+    }
+
+private:
+    struct vertex_hash {
+        std::size_t operator()(const vertex& v) const {
+            auto h = std::hash<std::size_t>{}(v.branch);
+            h = h * 31 + std::hash<int>{}(v.coefficient);
+            h = h * 31 + v.then_node;
+            return h * 31 + v.else_node;
+        }
+    };
+
+    struct vertex_equal {
+        bool operator()(const vertex& lhs, const vertex& rhs) const {
+            return lhs.branch == rhs.branch && lhs.coefficient == rhs.coefficient &&
+                lhs.then_node == rhs.then_node && lhs.else_node == rhs.else_node;
+        }
+    };
+
+    /// @return the vertex for the given label and children, zero-suppressed: a then edge to zero is dropped
+    node make(const std::size_t branch, const int coefficient, const node then_node, const node else_node) {
+        if (then_node == zero || coefficient == 0) return else_node;
+
+        const vertex v{ branch, coefficient, then_node, else_node };
+        const auto it = unique.find(v);
+        if (it != std::end(unique)) return it->second;
+
+        const auto id = static_cast<node>(vertices.size());
+        vertices.push_back(v);
+        unique.emplace(v, id);
+
+        return id;
+    }
+
+    /// @brief state of a single build(): the ordered entries and the submatrices expanded so far
+    class expansion {
+    public:
+        expansion(determinant_diagram& diagram, const symbolic_matrix& m) : diagram(diagram), n{m.size()} {
+            // rows and columns ranked by a minimum degree order of the symmetrized pattern
+            sparse_matrix<int> pattern{0, n};
+            pattern.reserve(n, m.get_entries().size());
+            auto it = std::begin(m.get_entries());
+            for (const auto row : ext::range(0, n)) {
+                pattern.add_row();
+                for (; it != std::end(m.get_entries()) && it->first.first == row; ++it) pattern.push_back(it->first.second, 1);
+            }
+
+            const auto order = minimum_degree_order(pattern);
+            std::vector<std::size_t> rank(n);
+            for (const auto i : ext::range(0, n)) rank[order[i]] = i;
+
+            for (const auto& e : m.get_entries()) entries.push_back({ e.first.first, e.first.second, &e.second });
+            std::sort(std::begin(entries), std::end(entries), [&rank] (const entry& lhs, const entry& rhs) {
+                const auto lhs_key = std::make_pair(std::min(rank[lhs.row], rank[lhs.col]), std::max(rank[lhs.row], rank[lhs.col]));
+                const auto rhs_key = std::make_pair(std::min(rank[rhs.row], rank[rhs.col]), std::max(rank[rhs.row], rank[rhs.col]));
+                return lhs_key != rhs_key ? lhs_key < rhs_key : std::make_pair(lhs.row, lhs.col) < std::make_pair(rhs.row, rhs.col);
+            });
+
+            row_entries.resize(n);
+            col_entries.resize(n);
+            for (const auto p : ext::range(0, entries.size())) {
+                row_entries[entries[p].row].push_back(p);
+                col_entries[entries[p].col].push_back(p);
+            }
+        }
+
+        node run() {
+            const auto all = n == 64 ? ~std::uint64_t{} : (std::uint64_t{1} << n) - 1;
+            return expand(all, all, 0);
+        }
+
+    private:
+        struct entry {
+            std::size_t row;
+            std::size_t col;
+            const std::vector<symbolic_term>* terms;
+        };
+
+        struct state {
+            std::uint64_t rows;
+            std::uint64_t cols;
+            std::size_t position;
+
+            bool operator==(const state& other) const {
+                return rows == other.rows && cols == other.cols && position == other.position;
+            }
+        };
+
+        struct state_hash {
+            std::size_t operator()(const state& s) const {
+                return std::hash<std::uint64_t>{}(s.rows * 0x9e3779b97f4a7c15ull ^ s.cols) * 31 + s.position;
+            }
+        };
+
+        static bool contains(const std::uint64_t set, const std::size_t i) { return (set >> i) & 1; }
+
+        /// @return number of members of `set` below i
+        static std::size_t rank_in(const std::uint64_t set, const std::size_t i) {
+            std::size_t result{};
+            for (auto rest = set & ((std::uint64_t{1} << i) - 1); rest != 0; rest &= rest - 1) ++result;
+            return result;
+        }
+
+        /// @return whether every remaining row and column still has an entry from `position` on
+        bool feasible(const std::uint64_t rows, const std::uint64_t cols, const std::size_t position) const {
+            const auto covered = [&] (const std::vector<std::vector<std::size_t>>& lines, const std::uint64_t set,
+                                      const std::uint64_t others, const bool by_row) {
+                for (const auto i : ext::range(0, n)) {
+                    if (!contains(set, i)) continue;
+
+                    const auto& list = lines[i];
+                    const auto found = std::any_of(std::lower_bound(std::begin(list), std::end(list), position), std::end(list),
+                        [&] (const std::size_t p) { return contains(others, by_row ? entries[p].col : entries[p].row); });
+                    if (!found) return false;
+                }
+
+                return true;
+            };
+
+            return covered(row_entries, rows, cols, true) && covered(col_entries, cols, rows, false);
+        }
+
+        /// @brief determinant of the submatrix of the remaining rows and columns, entries before `position` zeroed
+        node expand(const std::uint64_t rows, const std::uint64_t cols, std::size_t position) {
+            if (rows == 0) return one;
+
+            while (position < entries.size() &&
+                   !(contains(rows, entries[position].row) && contains(cols, entries[position].col))) {
+                ++position;
+            }
+            if (position == entries.size()) return zero;
+
+            const state key{ rows, cols, position };
+            const auto known = memo.find(key);
+            if (known != std::end(memo)) return known->second;
+
+            node result{zero};
+            if (feasible(rows, cols, position)) {
+                const auto& e = entries[position];
+                const auto sign = (rank_in(rows, e.row) + rank_in(cols, e.col)) % 2 == 0 ? 1 : -1;
+                const auto cofactor = expand(rows & ~(std::uint64_t{1} << e.row), cols & ~(std::uint64_t{1} << e.col), position + 1);
+
+                result = expand(rows, cols, position + 1);
+                const auto& terms = *e.terms;
+                for (const auto t : ext::reverse_range(0, terms.size())) {
+                    result = diagram.make(terms[t].branch, sign * terms[t].coefficient, cofactor, result);
+                }
+            }
+
+            memo.emplace(key, result);
+            return result;
+        }
+
+        determinant_diagram& diagram;
+        const std::size_t n;
+        std::vector<entry> entries;
+        /// positions of the entries of every row and column, ascending
+        std::vector<std::vector<std::size_t>> row_entries, col_entries;
+        std::unordered_map<state, node, state_hash> memo;
+    };
+
+    std::vector<vertex> vertices;
+    std::unordered_map<vertex, node, vertex_hash, vertex_equal> unique;
+};
+
+/** \brief symbolic network function H(s) = V_output / input as a ratio of two determinant diagrams
+    The matrix is the modified nodal one of mna.hpp in symbolic form: node rows hold sums of branch
+    admittances, 1/R, s C and 1/(s L), read off the incidence matrix of the analysis, and every
+    voltage source adds a row and a column of incidence constants. The input source is set to 1,
+    the other voltage sources are shorts and the other current sources are opened. By Cramer's rule
+    the numerator is the determinant of the matrix whose output column is replaced by the excitation.
+*/
+struct network_function {
+    determinant_diagram diagram;
+    determinant_diagram::node numerator;
+    determinant_diagram::node denominator;
+    /// branches of the analysis, in the order the diagrams refer to them
+    circuit branches;
+    std::string input;
+    std::size_t output;
+
+    /// @return admittance of a branch at the complex frequency s
+    std::complex<double> admittance(const std::size_t branch, const std::complex<double> s) const {
+        const auto value = branches.value(branch);
+        switch (branches.type(branch)) {
+        case element_type::resistor: return 1.0 / value;
+        case element_type::capacitor: return s * value;
+        case element_type::inductor: return 1.0 / (s * value);
+        default: throw std::logic_error{"sources have no admittance"};
+        }
+    }
+
+    std::complex<double> evaluate(const std::complex<double> s) const {
+        const auto y = [this, s] (const std::size_t branch) { return admittance(branch, s); };
+        return diagram.evaluate<std::complex<double>>(numerator, y) / diagram.evaluate<std::complex<double>>(denominator, y);
+    }
+};
+
+/// @return network function from the independent source named `input` to the potential of node `output`
+network_function make_network_function(const analysis& a, const std::string& input, const std::size_t output) {
+    const auto& c = a.get_circuit();
+    const auto& incidence = a.get_incidence_matrix();
+    const auto node_num = incidence.row_num();
+    const auto output_row = a.get_node_map().compact(output);
+    if (output_row >= node_num) throw std::runtime_error{"node " + std::to_string(output) + " is the reference node"};
+
+    const auto incidence_t = transpose(incidence);
+    std::size_t size{node_num}, input_branch{symbolic_matrix::none}, input_row{symbolic_matrix::none};
+    std::vector<std::size_t> current_rows(c.size(), symbolic_matrix::none);
+    for (const auto branch : ext::range(0, c.size())) {
+        if (c.name(branch) == input) input_branch = branch;
+        if (c.type(branch) == element_type::voltage_source) current_rows[branch] = size++;
+    }
+    if (input_branch == symbolic_matrix::none || !c.is_source(input_branch)) {
+        throw std::runtime_error{"no independent source named " + input};
+    }
+
+    symbolic_matrix m{size};
+    for (const auto branch : ext::range(0, c.size())) {
+        const auto ends = incidence_t.row(branch);
+        switch (c.type(branch)) {
+        case element_type::current_source:
+            break;
+        case element_type::voltage_source:
+            for (const auto& e : ends) {
+                m.add(e.col, current_rows[branch], { symbolic_matrix::none, e.value });
+                m.add(current_rows[branch], e.col, { symbolic_matrix::none, e.value });
+            }
+            break;
+        default:
+            for (const auto& i : ends) {
+                for (const auto& j : ends) m.add(i.col, j.col, { branch, i.value * j.value });
+            }
+        }
+    }
+
+    network_function result{ {}, {}, {}, c, input, output };
+    result.denominator = result.diagram.build(m);
+    if (result.denominator == determinant_diagram::zero) {
+        throw std::runtime_error{"the circuit equations are singular, the network function does not exist"};
+    }
+
+    // the excitation: a unit voltage in the source's row, or a unit current leaving its tail and entering its head
+    m.clear_column(output_row);
+    if (c.type(input_branch) == element_type::voltage_source) {
+        input_row = current_rows[input_branch];
+        m.add(input_row, output_row, { symbolic_matrix::none, 1 });
+    } else {
+        for (const auto& e : incidence_t.row(input_branch)) m.add(e.col, output_row, { symbolic_matrix::none, -e.value });
+    }
+    result.numerator = result.diagram.build(m);
+
+    return result;
+}
+
+namespace detail {
+    /** \brief writes a product of admittances as s^k * C.../(R... L...)
+        Capacitors contribute s C to the numerator, resistors R and inductors s L to the denominator.
+    */
+    inline void write_product(std::ostream& os, const circuit& c, const std::vector<std::size_t>& branches) {
+        int power{};
+        std::vector<std::string> numerator{}, denominator{};
+        for (const auto branch : branches) {
+            switch (c.type(branch)) {
+            case element_type::capacitor: ++power; numerator.push_back(c.name(branch)); break;
+            case element_type::inductor: --power; denominator.push_back(c.name(branch)); break;
+            default: denominator.push_back(c.name(branch)); break;
+            }
+        }
+
+        if (power > 0) numerator.insert(std::begin(numerator), power == 1 ? "s" : "s^" + std::to_string(power));
+        if (power < 0) denominator.insert(std::begin(denominator), power == -1 ? "s" : "s^" + std::to_string(-power));
+
+        const auto write_names = [&os] (const std::vector<std::string>& names) {
+            for (const auto i : ext::range(0, names.size())) os << (i == 0 ? "" : "*") << names[i];
+        };
+
+        if (numerator.empty()) os << '1';
+        else write_names(numerator);
+
+        if (denominator.empty()) return;
+        os << '/';
+        if (denominator.size() > 1) os << '(';
+        write_names(denominator);
+        if (denominator.size() > 1) os << ')';
+    }
+
+    using product_list = std::vector<std::pair<std::vector<std::size_t>, long long>>;
+
+    /// @return sum of products ordered by descending power of s, then by the branches of each product
+    inline product_list ordered_products(const network_function& f, const determinant_diagram::node root) {
+        const auto terms = f.diagram.sum_of_products(root);
+        const auto power = [&f] (const std::vector<std::size_t>& branches) {
+            int result{};
+            for (const auto branch : branches) {
+                const auto type = f.branches.type(branch);
+                result += type == element_type::capacitor ? 1 : type == element_type::inductor ? -1 : 0;
+            }
+            return result;
+        };
+
+        product_list result(std::begin(terms), std::end(terms));
+        std::stable_sort(std::begin(result), std::end(result),
+            [&power] (const product_list::value_type& lhs, const product_list::value_type& rhs) {
+                return power(lhs.first) > power(rhs.first);
+            });
+
+        return result;
+    }
+
+    inline void write_sum_of_products(std::ostream& os, const circuit& c, const product_list& products, const int sign) {
+        if (products.empty()) {
+            os << '0';
+            return;
+        }
+
+        for (const auto i : ext::range(0, products.size())) {
+            const auto coefficient = sign * products[i].second;
+            if (i != 0) os << (coefficient < 0 ? " - " : " + ");
+            else if (coefficient < 0) os << '-';
+
+            const auto magnitude = coefficient < 0 ? -coefficient : coefficient;
+            if (magnitude != 1) os << magnitude << '*';
+            write_product(os, c, products[i].first);
+        }
+    }
+} /* namespace detail */
+
+/** \brief writes H(s) = V_output / input as numerator and denominator sums of products and the diagram sizes
+    Both are negated when the leading denominator term is negative. The sums of products are written
+    only up to `max_terms` paths per diagram, their number growing exponentially with the circuit.
+*/
+void write_network_function(std::ostream& os, const network_function& f, const double max_terms = 1e5) {
+    os << "H(s) = V_" << f.output << " / " << f.input << '\n';
+
+    const auto numerator_paths = f.diagram.path_num(f.numerator), denominator_paths = f.diagram.path_num(f.denominator);
+    if (numerator_paths <= max_terms && denominator_paths <= max_terms) {
+        const auto numerator = detail::ordered_products(f, f.numerator), denominator = detail::ordered_products(f, f.denominator);
+        const auto sign = !denominator.empty() && denominator.front().second < 0 ? -1 : 1;
+
+        os << "numerator: ";
+        detail::write_sum_of_products(os, f.branches, numerator, sign);
+        os << "\ndenominator: ";
+        detail::write_sum_of_products(os, f.branches, denominator, sign);
+        os << '\n';
+    } else {
+        os << "numerator: " << numerator_paths << " product terms\ndenominator: " << denominator_paths << " product terms\n";
+    }
+
+    os << "vertices: " << f.diagram.size(f.numerator) << " numerator, " << f.diagram.size(f.denominator)
+        << " denominator, " << f.diagram.size() - 2 << " total\n";
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "range.hpp"
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+/// @brief disjoint-set forest with union by rank and path halving, amortized O(α(n)) per operation
+class disjoint_set {
+public:
+    explicit disjoint_set(const std::size_t size) : parent(size), rank(size) {
+        for (const auto i : ext::range(0, size)) parent[i] = i;
+    }
+
+    std::size_t size() const { return parent.size(); }
+
+    std::size_t find(std::size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+
+        return x;
+    }
+
+    /// @return false if `x` and `y` already belong to the same set
+    bool unite(std::size_t x, std::size_t y) {
+        x = find(x);
+        y = find(y);
+        if (x == y) return false;
+
+        if (rank[x] < rank[y]) std::swap(x, y);
+        parent[y] = x;
+        if (rank[x] == rank[y]) ++rank[x];
+
+        return true;
+    }
+
+private:
+    std::vector<std::size_t> parent;
+    std::vector<unsigned char> rank;
+};
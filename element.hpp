@@ -1,11 +1,12 @@
 #pragma once
 
-#include <map>
+#include <string>
 #include <ostream>
 #include <stdexcept>
+#include <cstdint>
 #include <cstddef>
 
-enum struct element_type {
+enum struct element_type : std::uint8_t {
 	voltage_source,
 	capacitor,
 	resistor,
@@ -13,52 +14,46 @@ enum struct element_type {
 	current_source
 };
 
-std::string to_string(const element_type& type) {
-    static const std::map<element_type, std::string> map{
-    	{ element_type::voltage_source, "element_type::voltage_source" },
-    	{ element_type::capacitor, "element_type::capacitor" },
-    	{ element_type::resistor, "element_type::resistor" },
-    	{ element_type::inductor, "element_type::inductor" },
-    	{ element_type::current_source, "element_type::current_source" }
+/// @brief per-type traits indexed by element_type, kept in the order of the enumerators
+namespace element_traits {
+    const std::size_t type_num{5};
+
+    constexpr const char* names[type_num]{
+        "element_type::voltage_source",
+        "element_type::capacitor",
+        "element_type::resistor",
+        "element_type::inductor",
+        "element_type::current_source"
     };
 
-    const auto it = map.find(type);
-    return it != std::end(map) ? it->second : throw std::logic_error{"invalid element_type value"};
+    constexpr bool voltage_defined[type_num]{ true, false, false, true, false };
+    constexpr bool source[type_num]{ true, false, false, false, true };
+
+    constexpr std::size_t index(const element_type type) {
+        return static_cast<std::size_t>(type) < type_num ? static_cast<std::size_t>(type)
+            : throw std::logic_error{"invalid element_type value"};
+    }
+} /* namespace element_traits */
+
+inline std::string to_string(const element_type type) {
+    return element_traits::names[element_traits::index(type)];
 }
 
 /// @note we currently assume that every branch is either voltage-defined or current-defined
-bool is_voltage_defined(const element_type& type) {
-   static const std::map<element_type, bool> map{
-    	{ element_type::voltage_source, true },
-    	{ element_type::capacitor, false },
-    	{ element_type::resistor, false },
-    	{ element_type::inductor, true },
-    	{ element_type::current_source, false }
-    };
-
-    const auto it = map.find(type);
-    return it != std::end(map) ? it->second : throw std::logic_error{"invalid element_type value"};
+constexpr bool is_voltage_defined(const element_type type) {
+    return element_traits::voltage_defined[element_traits::index(type)];
 }
 
-inline bool is_current_defined(const element_type& type) {
+constexpr bool is_current_defined(const element_type type) {
     return !is_voltage_defined(type);
 }
 
-bool is_source(const element_type& type) {
-   static const std::map<element_type, bool> map{
-    	{ element_type::voltage_source, true },
-    	{ element_type::capacitor, false },
-    	{ element_type::resistor, false },
-    	{ element_type::inductor, false },
-    	{ element_type::current_source, true }
-    };
-
-    const auto it = map.find(type);
-    return it != std::end(map) ? it->second : throw std::logic_error{"invalid element_type value"};
+constexpr bool is_source(const element_type type) {
+    return element_traits::source[element_traits::index(type)];
 }
 
-std::ostream& operator<<(std::ostream& os, element_type type) {
-    return os << to_string(type);
+inline std::ostream& operator<<(std::ostream& os, const element_type type) {
+    return os << element_traits::names[element_traits::index(type)];
 }
 
 struct element {
@@ -66,6 +61,8 @@ struct element {
     std::size_t tail;
     std::size_t head;
     std::string name;
+    /// resistance, capacitance, inductance or source value in SI units, 0 if the netlist gives none
+    double value;
 
     bool is_voltage_defined() const { return ::is_voltage_defined(type); }
     bool is_current_defined() const { return ::is_current_defined(type); }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "equations.hpp"
+#include <vector>
+#include <cstring>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+/// @brief accumulates output in a fixed-size buffer and hands it to the stream in large blocks
+class buffered_writer {
+public:
+    explicit buffered_writer(std::ostream& os, const std::size_t capacity = 1 << 16)
+        : os(os), buffer(capacity), used{} {}
+    ~buffered_writer() { flush(); }
+
+    buffered_writer(const buffered_writer&) = delete;
+    buffered_writer& operator=(const buffered_writer&) = delete;
+
+    void write(const char* data, std::size_t length) {
+        if (used + length > buffer.size()) {
+            flush();
+            if (length > buffer.size()) {
+                os.write(data, length);
+                return;
+            }
+        }
+
+        std::memcpy(buffer.data() + used, data, length);
+        used += length;
+    }
+
+    buffered_writer& operator<<(const char* const str) {
+        write(str, std::strlen(str));
+        return *this;
+    }
+
+    buffered_writer& operator<<(const char c) {
+        write(&c, 1);
+        return *this;
+    }
+
+    buffered_writer& operator<<(std::uint64_t value) {
+        char digits[20];
+        auto first = std::end(digits);
+        do {
+            *--first = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+
+        write(first, std::end(digits) - first);
+        return *this;
+    }
+
+    buffered_writer& operator<<(const std::uint32_t value) { return *this << static_cast<std::uint64_t>(value); }
+
+    void flush() {
+        os.write(buffer.data(), used);
+        used = 0;
+    }
+
+private:
+    std::ostream& os;
+    std::vector<char> buffer;
+    std::size_t used;
+};
+
+/** \brief equation sink rendering a system of equations as it is generated
+    Produces the same text as operator<< on system_of_equations without keeping anything but
+    the output buffer, see analysis::emit_model_equations.
+*/
+class equation_writer {
+public:
+    equation_writer(std::ostream& os, const symbol_table& symbols)
+        : out{os}, symbols(symbols), state{state_t::initial} {}
+
+    void add_unknown(const unknown& var) {
+        out << (state == state_t::initial ? "unknowns: (" : ", ");
+        write_unknown(out, symbols, var);
+        state = state_t::unknowns;
+    }
+
+    void add_equation(const equation& equation) {
+        close_unknowns();
+        write_equation(out, equation) << '\n';
+    }
+
+    /// @brief completes the output and flushes it to the stream
+    void finish() {
+        close_unknowns();
+        out.flush();
+    }
+
+private:
+    void close_unknowns() {
+        if (state == state_t::equations) return;
+
+        out << (state == state_t::initial ? "unknowns: ()^T\n" : ")^T\n");
+        state = state_t::equations;
+    }
+
+    enum struct state_t { initial, unknowns, equations };
+
+    buffered_writer out;
+    const symbol_table& symbols;
+    state_t state;
+};
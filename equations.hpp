@@ -0,0 +1,261 @@
+#pragma once
+
+#include "symbol_table.hpp"
+#include "range.hpp"
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+enum struct unknown_kind : std::uint8_t {
+    node_potential,
+    branch_current,
+    branch_voltage
+};
+
+/// @brief an unknown of the system, `index` is the symbol of the node number or of the branch element
+struct unknown {
+    unknown_kind kind;
+    std::uint32_t index;
+};
+
+/** \brief how a term is formed from its element and unknown
+    one:        unknown                 I_E1, V_0
+    value:      element                 E1
+    reciprocal: 1 / element * unknown   1 / R1 * V_0
+    derivative: element * dunknown/dt   C1 * dV_0/dt
+*/
+enum struct coefficient_kind : std::uint8_t {
+    one,
+    value,
+    reciprocal,
+    derivative
+};
+
+/// @brief compact term record, rendered to text only on output; `sign` set means the term is subtracted
+struct equation_term {
+    coefficient_kind kind;
+    unknown_kind var_kind;
+    bool sign;
+    std::uint32_t element;
+    std::uint32_t var;
+
+    unknown get_unknown() const { return { var_kind, var }; }
+};
+
+inline equation_term make_term(const coefficient_kind kind, const bool sign,
+                               const std::uint32_t element, const unknown var = {}) {
+    return { kind, var.kind, sign, element, var.index };
+}
+
+/// @brief view of a single equation inside an equation_list
+class equation {
+public:
+    equation(const equation_term* const first, const equation_term* const last, const symbol_table& symbols)
+        : first{first}, last{last}, symbols(symbols) {}
+
+    const equation_term* begin() const { return first; }
+    const equation_term* end() const { return last; }
+    std::size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+    const symbol_table& get_symbols() const { return symbols; }
+
+private:
+    const equation_term* first;
+    const equation_term* last;
+    const symbol_table& symbols;
+};
+
+/** \brief equations stored back to back in a single term arena
+    An equation is started with add_equation() and filled with push_back(), terms refer to the
+    shared symbol table for element names.
+*/
+class equation_list {
+public:
+    explicit equation_list(std::shared_ptr<const symbol_table> symbols)
+        : symbols{std::move(symbols)}, offsets{0} {}
+
+    std::size_t size() const { return offsets.size() - 1; }
+    std::size_t term_num() const { return terms.size(); }
+
+    void reserve(const std::size_t equation_num, const std::size_t term_num) {
+        offsets.reserve(equation_num + 1);
+        terms.reserve(term_num);
+    }
+
+    void add_equation() { offsets.push_back(terms.size()); }
+
+    void clear() {
+        offsets.assign(1, 0);
+        terms.clear();
+    }
+
+    /// @brief appends a term to the last equation
+    void push_back(const equation_term& term) {
+        terms.push_back(term);
+        ++offsets.back();
+    }
+
+    /// @brief appends all terms of `other` to the last equation
+    void append(const equation& other) {
+        terms.insert(std::end(terms), std::begin(other), std::end(other));
+        offsets.back() += other.size();
+    }
+
+    equation operator[](const std::size_t index) const {
+        return { terms.data() + offsets[index], terms.data() + offsets[index + 1], *symbols };
+    }
+
+    const symbol_table& get_symbols() const { return *symbols; }
+    const std::shared_ptr<const symbol_table>& get_symbol_table() const { return symbols; }
+
+private:
+    std::shared_ptr<const symbol_table> symbols;
+    /// equation i occupies terms [offsets[i], offsets[i + 1])
+    std::vector<std::size_t> offsets;
+    std::vector<equation_term> terms;
+};
+
+struct system_of_equations {
+    std::vector<unknown> unknowns;
+    equation_list equations;
+};
+
+/// @brief collects streamed unknowns and equations into a system_of_equations, see analysis::emit_model_equations
+class equation_collector {
+public:
+    explicit equation_collector(std::shared_ptr<const symbol_table> symbols)
+        : system{ {}, equation_list{std::move(symbols)} } {}
+
+    void add_unknown(const unknown& var) { system.unknowns.push_back(var); }
+
+    void add_equation(const equation& equation) {
+        system.equations.add_equation();
+        system.equations.append(equation);
+    }
+
+    system_of_equations release() { return std::move(system); }
+
+private:
+    system_of_equations system;
+};
+
+/// @brief feeds a system to a sink as analysis::emit_model_equations would: all unknowns, then all equations
+template<typename Sink> void emit_system(const system_of_equations& system, Sink& sink) {
+    for (const auto& var : system.unknowns) sink.add_unknown(var);
+    for (const auto index : ext::range(0, system.equations.size())) sink.add_equation(system.equations[index]);
+}
+
+/** \brief concatenates systems built over different symbol tables
+    Every symbol is re-interned into a single new table, so equal names end up sharing an id.
+*/
+system_of_equations merge_systems(const std::vector<system_of_equations>& systems) {
+    const auto symbols = std::make_shared<symbol_table>();
+    system_of_equations result{ {}, equation_list{symbols} };
+
+    std::size_t unknown_num{}, equation_num{}, term_num{};
+    for (const auto& system : systems) {
+        unknown_num += system.unknowns.size();
+        equation_num += system.equations.size();
+        term_num += system.equations.term_num();
+    }
+    result.unknowns.reserve(unknown_num);
+    result.equations.reserve(equation_num, term_num);
+
+    std::vector<symbol_table::id> ids{};
+    for (const auto& system : systems) {
+        const auto& source = system.equations.get_symbols();
+        ids.assign(source.size(), symbol_table::npos);
+        const auto remap = [&] (const symbol_table::id symbol) {
+            if (ids[symbol] == symbol_table::npos) ids[symbol] = symbols->intern(source.data(symbol), source.length(symbol));
+            return ids[symbol];
+        };
+
+        for (const auto& var : system.unknowns) result.unknowns.push_back({ var.kind, remap(var.index) });
+
+        for (const auto index : ext::range(0, system.equations.size())) {
+            result.equations.add_equation();
+            for (auto term : system.equations[index]) {
+                term.element = remap(term.element);
+                if (term.kind != coefficient_kind::value) term.var = remap(term.var);
+                result.equations.push_back(term);
+            }
+        }
+    }
+
+    return result;
+}
+
+/// the write_* functions render to any stream supporting `<<` of strings and integers and write()
+template<typename Stream>
+inline Stream& write_symbol(Stream& os, const symbol_table& symbols, const std::uint32_t symbol) {
+    os.write(symbols.data(symbol), symbols.length(symbol));
+    return os;
+}
+
+template<typename Stream>
+Stream& write_unknown(Stream& os, const symbol_table& symbols, const unknown var) {
+    switch (var.kind) {
+    case unknown_kind::node_potential: return write_symbol(os << "V_", symbols, var.index);
+    case unknown_kind::branch_current: return write_symbol(os << "I_", symbols, var.index);
+    case unknown_kind::branch_voltage: return write_symbol(os << "U_", symbols, var.index);
+    }
+
+    throw std::logic_error{"invalid unknown_kind value"};
+}
+
+template<typename Stream>
+Stream& write_term(Stream& os, const symbol_table& symbols, const equation_term& term) {
+    switch (term.kind) {
+    case coefficient_kind::one: return write_unknown(os, symbols, term.get_unknown());
+    case coefficient_kind::value: return write_symbol(os, symbols, term.element);
+    case coefficient_kind::reciprocal:
+        return write_unknown(write_symbol(os << "1 / ", symbols, term.element) << " * ", symbols, term.get_unknown());
+    case coefficient_kind::derivative:
+        return write_unknown(write_symbol(os, symbols, term.element) << " * d", symbols, term.get_unknown()) << "/dt";
+    }
+
+    throw std::logic_error{"invalid coefficient_kind value"};
+}
+
+template<typename Stream>
+Stream& write_equation(Stream& os, const equation& equation) {
+    auto first = true;
+    for (const auto& term : equation) {
+        os << (first ? term.sign ? "-" : "" : term.sign ? " - " : " + ");
+        write_term(os, equation.get_symbols(), term);
+        first = false;
+    }
+    if (!first) os << " = 0";
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const equation& equation) {
+    return write_equation(os, equation);
+}
+
+std::ostream& operator<<(std::ostream& os, const equation_list& equations) {
+    for (const auto index : ext::range(0, equations.size())) {
+        os << equations[index] << '\n';
+    }
+
+    return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const system_of_equations& system) {
+    os << "unknowns: (";
+
+    auto first = true;
+    for (const auto& unknown : system.unknowns) {
+        write_unknown(os << (first ? "" : ", "), system.equations.get_symbols(), unknown);
+        first = false;
+    }
+
+    os << ")^T\n" << system.equations;
+
+    return os;
+}
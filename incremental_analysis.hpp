@@ -0,0 +1,490 @@
+#pragma once
+
+#include "circuit.hpp"
+#include "circuit_from_stream.hpp"
+#include "node_map.hpp"
+#include "topology.hpp"
+#include "equations.hpp"
+#include "symbol_table.hpp"
+#include "range.hpp"
+#include <vector>
+#include <map>
+#include <string>
+#include <memory>
+#include <istream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+
+/** \brief model of a circuit kept up to date while elements are added, removed or retyped
+    Starts from the spanning tree a full analysis would choose and then maintains it: a new element
+    reaching a new node becomes a tree branch, any other one becomes a link; a removed tree branch
+    is replaced by a link crossing the cut it leaves (link swap). Fundamental loops (rows of B) and
+    cut-sets (rows of D) are stored per element and only the rows touching the changed element are
+    patched, as are the KCL equations of its end nodes. The reference node is the highest numbered
+    node of the initial circuit for the whole lifetime of the object.
+    After edits the tree is generally not the one a fresh analysis would select, so equations come
+    out in a different but equivalent form.
+*/
+class incremental_analysis {
+public:
+    explicit incremental_analysis(const circuit& c) : symbols{std::make_shared<symbol_table>()} {
+        if (c.empty()) throw std::runtime_error{"cannot analyze an empty circuit"};
+
+        const node_map numbering{c};
+        const auto cir = select_spanning_tree(normalize(numbering.apply(c)));
+        const auto tree = root_spanning_tree(cir);
+        const auto b = fundamental_loop_matrix(cir, tree);
+
+        // node slot i is compact node i, branch id i is branch i of the ordered circuit
+        for (const auto node : ext::range(0, numbering.size())) {
+            add_node(numbering.original(node));
+            nodes[node].parent = tree.parent[node];
+            nodes[node].parent_branch = tree.parent_branch[node];
+            nodes[node].depth = tree.depth[node];
+        }
+        reference = tree.root();
+        nodes[reference].parent_branch = none;
+
+        for (const auto branch : ext::range(0, cir.size())) {
+            add_branch(cir.type(branch), cir.tail(branch), cir.head(branch),
+                symbols->intern(cir.name_data(branch), cir.name_length(branch)));
+            branches[branch].in_tree = branch < tree.size();
+        }
+
+        for (const auto row : ext::range(0, b.row_num())) {
+            const auto link = tree.size() + row;
+            for (const auto& e : b.row(row)) {
+                if (e.col == link) continue;
+                loops[link][e.col] = e.value;
+                cutsets[e.col][link] = -e.value;
+            }
+        }
+
+        for (const auto node : ext::range(0, nodes.size())) update_kcl(node);
+    }
+
+    std::size_t size() const { return element_num; }
+    const symbol_table& get_symbols() const { return *symbols; }
+
+    /// @brief adds an element, at least one of its nodes must already be in the circuit
+    void add_element(const element& el) {
+        const auto symbol = symbols->intern(el.name);
+        if (find_branch(symbol) != none) throw std::runtime_error{"duplicate element name " + el.name};
+
+        const auto tail_it = node_slots.find(el.tail), head_it = node_slots.find(el.head);
+        const auto has_tail = tail_it != std::end(node_slots), has_head = head_it != std::end(node_slots);
+        if (!has_tail && !has_head) throw std::runtime_error{"the circuit graph is not connected"};
+
+        if (has_tail && has_head) {
+            const auto link = add_branch(el.type, tail_it->second, head_it->second, symbol);
+            set_loop(link, compute_loop(link));
+        } else {
+            // the new node hangs off the tree through the new branch, no loop passes through it
+            const auto old_node = has_tail ? tail_it->second : head_it->second;
+            const auto new_node = add_node(has_tail ? el.head : el.tail);
+            const auto branch = has_tail ? add_branch(el.type, old_node, new_node, symbol)
+                : add_branch(el.type, new_node, old_node, symbol);
+
+            branches[branch].in_tree = true;
+            nodes[new_node].parent = old_node;
+            nodes[new_node].parent_branch = branch;
+            nodes[new_node].depth = nodes[old_node].depth + 1;
+        }
+
+        const auto& added = branches.back();
+        update_kcl(added.tail);
+        update_kcl(added.head);
+    }
+
+    /// @brief removes an element, a tree branch is replaced by a link unless it is the only connection of a leaf node
+    void remove_element(const std::string& name) {
+        const auto branch = get_branch(name);
+        const auto tail = branches[branch].tail, head = branches[branch].head;
+
+        if (branches[branch].in_tree) {
+            const auto child = nodes[tail].parent_branch == branch ? tail : head;
+            const auto parent = child == tail ? head : tail;
+
+            if (!cutsets[branch].empty()) {
+                swap_link(branch, child);
+            } else if (nodes[child].branches.size() == 1) {
+                detach_branch(branch);
+                remove_node(child);
+                update_kcl(parent);
+                return;
+            } else {
+                throw std::runtime_error{"removing element " + name + " would disconnect the circuit"};
+            }
+        } else {
+            set_loop(branch, {});
+        }
+
+        detach_branch(branch);
+        update_kcl(tail);
+        update_kcl(head);
+    }
+
+    /// @brief changes the type of an element, the topology and hence B and D stay as they are
+    void retype_element(const std::string& name, const element_type type) {
+        const auto branch = get_branch(name);
+        if (branches[branch].type == type) return;
+
+        branches[branch].type = type;
+        update_kcl(branches[branch].tail);
+        update_kcl(branches[branch].head);
+    }
+
+    /// @brief fundamental cut-set equations, one per tree branch in the order elements were added
+    equation_list get_kcl_equations() const {
+        equation_list result{symbols};
+        for (const auto branch : ext::range(0, branches.size())) {
+            if (branches[branch].alive && branches[branch].in_tree) {
+                add_fundamental_equation(result, branch, cutsets[branch], unknown_kind::branch_current);
+            }
+        }
+
+        return result;
+    }
+
+    /// @brief fundamental loop equations, one per link in the order elements were added
+    equation_list get_kvl_equations() const {
+        equation_list result{symbols};
+        for (const auto branch : ext::range(0, branches.size())) {
+            if (branches[branch].alive && !branches[branch].in_tree) {
+                add_fundamental_equation(result, branch, loops[branch], unknown_kind::branch_voltage);
+            }
+        }
+
+        return result;
+    }
+
+    /// @brief same unknowns and equations as analysis::get_model_equations, nodes ordered by number
+    system_of_equations get_model_equations() const {
+        system_of_equations result{ {}, equation_list{symbols} };
+
+        for (const auto& slot : node_slots) {
+            if (slot.second == reference) continue;
+            result.unknowns.push_back({ unknown_kind::node_potential, nodes[slot.second].symbol });
+        }
+        for (const auto& branch : branches) {
+            if (branch.alive && is_voltage_defined(branch.type)) {
+                result.unknowns.push_back({ unknown_kind::branch_current, branch.symbol });
+            }
+        }
+
+        for (const auto& slot : node_slots) {
+            if (slot.second == reference) continue;
+
+            result.equations.add_equation();
+            for (const auto& term : nodes[slot.second].kcl) result.equations.push_back(term);
+        }
+
+        std::vector<equation_term> terms{};
+        for (const auto branch : ext::range(0, branches.size())) {
+            const auto& state = branches[branch];
+            if (!state.alive || !is_voltage_defined(state.type)) continue;
+
+            terms.clear();
+            push_potentials(terms, coefficient_kind::one, false, branch);
+            if (state.type == element_type::voltage_source) {
+                terms.push_back(make_term(coefficient_kind::value, true, state.symbol));
+            } else if (state.type == element_type::inductor) {
+                terms.push_back(make_term(coefficient_kind::derivative, true, state.symbol,
+                    { unknown_kind::branch_current, state.symbol }));
+            }
+
+            result.equations.add_equation();
+            for (const auto& term : terms) result.equations.push_back(term);
+        }
+
+        return result;
+    }
+
+private:
+    enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+    /// entries of a fundamental loop or cut-set other than the element's own, keyed by branch id
+    using fundamental_row = std::map<std::size_t, int>;
+
+    struct node_state {
+        std::size_t number;
+        symbol_table::id symbol;
+        std::size_t parent;
+        std::size_t parent_branch;
+        std::size_t depth;
+        /// ids of the incident branches in increasing order
+        std::vector<std::size_t> branches;
+        /// terms of the node's KCL model equation
+        std::vector<equation_term> kcl;
+    };
+
+    struct branch_state {
+        element_type type;
+        std::size_t tail;
+        std::size_t head;
+        symbol_table::id symbol;
+        bool alive;
+        bool in_tree;
+    };
+
+    std::size_t add_node(const std::size_t number) {
+        const auto node = nodes.size();
+        nodes.push_back({ number, symbols->intern(std::to_string(number)), none, none, 0, {}, {} });
+        node_slots[number] = node;
+
+        return node;
+    }
+
+    void remove_node(const std::size_t node) {
+        node_slots.erase(nodes[node].number);
+        nodes[node].kcl.clear();
+    }
+
+    std::size_t add_branch(const element_type type, const std::size_t tail, const std::size_t head,
+                           const symbol_table::id symbol) {
+        const auto branch = branches.size();
+        branches.push_back({ type, tail, head, symbol, true, false });
+        loops.emplace_back();
+        cutsets.emplace_back();
+
+        if (branch_ids.size() <= symbol) branch_ids.resize(symbol + 1, none);
+        branch_ids[symbol] = branch;
+
+        nodes[tail].branches.push_back(branch);
+        if (head != tail) nodes[head].branches.push_back(branch);
+        ++element_num;
+
+        return branch;
+    }
+
+    void detach_branch(const std::size_t branch) {
+        auto& state = branches[branch];
+        for (const auto node : { state.tail, state.head }) {
+            auto& incident = nodes[node].branches;
+            incident.erase(std::remove(std::begin(incident), std::end(incident), branch), std::end(incident));
+        }
+
+        branch_ids[state.symbol] = none;
+        state.alive = false;
+        state.in_tree = false;
+        --element_num;
+    }
+
+    std::size_t find_branch(const symbol_table::id symbol) const {
+        return symbol < branch_ids.size() ? branch_ids[symbol] : none;
+    }
+
+    std::size_t get_branch(const std::string& name) const {
+        const auto symbol = symbols->find(name);
+        const auto branch = symbol != symbol_table::npos ? find_branch(symbol) : none;
+        if (branch == none) throw std::runtime_error{"unknown element " + name};
+
+        return branch;
+    }
+
+    /// @brief the tree path closing the loop of `link`, oriented as in fundamental_loop_matrix
+    fundamental_row compute_loop(const std::size_t link) const {
+        fundamental_row result{};
+
+        auto u = branches[link].tail, v = branches[link].head;
+        while (u != v) {
+            if (nodes[u].depth >= nodes[v].depth) {
+                const auto branch = nodes[u].parent_branch;
+                result[branch] = branches[branch].tail == u ? -1 : 1;
+                u = nodes[u].parent;
+            } else {
+                const auto branch = nodes[v].parent_branch;
+                result[branch] = branches[branch].tail == v ? 1 : -1;
+                v = nodes[v].parent;
+            }
+        }
+
+        return result;
+    }
+
+    /// @brief replaces row `link` of B and patches the matching entries of D, whose columns are links
+    void set_loop(const std::size_t link, fundamental_row loop) {
+        for (const auto& e : loops[link]) cutsets[e.first].erase(link);
+        for (const auto& e : loop) cutsets[e.first][link] = -e.second;
+        loops[link] = std::move(loop);
+    }
+
+    /** \brief makes a link crossing the cut of tree branch `removed` a tree branch in its place
+        Every loop through `removed` gets the replacement's loop added or subtracted so that it no
+        longer passes through `removed`, i.e. B is pivoted on the replacement's row. The subtree
+        below `child` is then re-hung from the replacement link.
+    */
+    void swap_link(const std::size_t removed, const std::size_t child) {
+        const auto crossing = cutsets[removed];
+        const auto replacement = crossing.begin()->first;
+
+        auto pivot = loops[replacement];
+        pivot[replacement] = 1;
+        const auto pivot_sign = pivot[removed];
+
+        for (const auto& e : crossing) {
+            const auto link = e.first;
+            if (link == replacement) continue;
+
+            auto loop = loops[link];
+            const auto factor = loop[removed] * pivot_sign;
+            for (const auto& p : pivot) {
+                const auto value = (loop[p.first] -= factor * p.second);
+                if (value == 0) loop.erase(p.first);
+            }
+
+            set_loop(link, std::move(loop));
+        }
+        set_loop(replacement, {});
+        branches[replacement].in_tree = true;
+
+        // re-hang the detached subtree from the end of the replacement link lying inside it
+        const auto tail = branches[replacement].tail, head = branches[replacement].head;
+        const auto inner = is_below(tail, child) ? tail : head;
+        auto node = inner, new_parent = inner == tail ? head : tail, new_branch = replacement;
+        for (;;) {
+            const auto old_parent = nodes[node].parent, old_branch = nodes[node].parent_branch;
+            nodes[node].parent = new_parent;
+            nodes[node].parent_branch = new_branch;
+            if (node == child) break;
+
+            new_parent = node;
+            new_branch = old_branch;
+            node = old_parent;
+        }
+
+        // depths of the re-hung subtree, `queue` doubles as the list of visited nodes
+        nodes[inner].depth = nodes[nodes[inner].parent].depth + 1;
+        std::vector<std::size_t> queue{inner};
+        for (std::size_t i{}; i < queue.size(); ++i) {
+            const auto current = queue[i];
+            for (const auto branch : nodes[current].branches) {
+                if (!branches[branch].in_tree || branch == removed) continue;
+
+                const auto other = branches[branch].tail == current ? branches[branch].head : branches[branch].tail;
+                if (nodes[other].parent != current || nodes[other].parent_branch != branch) continue;
+
+                nodes[other].depth = nodes[current].depth + 1;
+                queue.push_back(other);
+            }
+        }
+    }
+
+    /// @return true if `node` lies in the subtree rooted at `root`
+    bool is_below(std::size_t node, const std::size_t root) const {
+        while (nodes[node].depth > nodes[root].depth) node = nodes[node].parent;
+        return node == root;
+    }
+
+    /// @brief V_tail - V_head of a branch, in node number order and leaving out the reference node
+    void push_potentials(std::vector<equation_term>& terms, const coefficient_kind kind, const bool sign,
+                         const std::size_t branch) const {
+        const auto& state = branches[branch];
+        if (state.tail == state.head) return;
+
+        const auto tail_first = nodes[state.tail].number < nodes[state.head].number;
+        for (const auto node : { tail_first ? state.tail : state.head, tail_first ? state.head : state.tail }) {
+            if (node == reference) continue;
+            terms.push_back(make_term(kind, sign ^ (node == state.head), state.symbol,
+                { unknown_kind::node_potential, nodes[node].symbol }));
+        }
+    }
+
+    /// @brief rebuilds the KCL model equation of a node from its incident branches
+    void update_kcl(const std::size_t node) {
+        auto& kcl = nodes[node].kcl;
+        kcl.clear();
+
+        for (const auto branch : nodes[node].branches) {
+            const auto& state = branches[branch];
+            if (state.tail == state.head) continue;
+
+            const auto sign = state.head == node;
+            if (is_voltage_defined(state.type)) {
+                kcl.push_back(make_term(coefficient_kind::one, sign, state.symbol,
+                    { unknown_kind::branch_current, state.symbol }));
+                continue;
+            }
+
+            const auto kind = state.type == element_type::capacitor ? coefficient_kind::derivative
+                : state.type == element_type::resistor ? coefficient_kind::reciprocal
+                : coefficient_kind::value;
+            if (kind == coefficient_kind::value) {
+                kcl.push_back(make_term(kind, sign, state.symbol));
+            } else {
+                push_potentials(kcl, kind, sign, branch);
+            }
+        }
+    }
+
+    void add_fundamental_equation(equation_list& equations, const std::size_t branch, const fundamental_row& row,
+                                  const unknown_kind kind) const {
+        const auto push = [&] (const std::size_t column, const int value) {
+            const auto symbol = branches[column].symbol;
+            equations.push_back(make_term(coefficient_kind::one, value < 0, symbol, { kind, symbol }));
+        };
+
+        equations.add_equation();
+        auto own = false;
+        for (const auto& e : row) {
+            if (!own && e.first > branch) {
+                push(branch, 1);
+                own = true;
+            }
+            push(e.first, e.second);
+        }
+        if (!own) push(branch, 1);
+    }
+
+    const std::shared_ptr<symbol_table> symbols;
+    std::vector<node_state> nodes;
+    /// node number -> node slot, for the nodes currently in the circuit
+    std::map<std::size_t, std::size_t> node_slots;
+    std::vector<branch_state> branches;
+    /// symbol of an element name -> branch id, none for names not in the circuit
+    std::vector<std::size_t> branch_ids;
+    /// loops[l] is row l of B for a link l, cutsets[t] is row t of D for a tree branch t
+    std::vector<fundamental_row> loops;
+    std::vector<fundamental_row> cutsets;
+    std::size_t reference{};
+    std::size_t element_num{};
+};
+
+/** \brief applies an edit script to `a`, one edit per line
+    + <element line>    adds an element written as in a netlist
+    - <name>            removes an element
+    ~ <name> <type>     retypes an element, the type given by its netlist letter E, C, R, L or I
+    Empty lines are skipped, errors name the offending line of the script.
+*/
+void apply_edits(incremental_analysis& a, std::istream& is) {
+    std::string line{};
+    for (std::size_t line_num{1}; std::getline(is, line); ++line_num) {
+        std::istringstream fields{line};
+        std::string edit{}, name{}, type{};
+        if (!(fields >> edit)) continue;
+
+        try {
+            if (edit == "+") {
+                std::string rest{};
+                std::getline(fields, rest);
+                const auto added = circuit_from_buffer(rest.data(), rest.data() + rest.size());
+                if (added.size() != 1) throw std::runtime_error{"expected an element"};
+                a.add_element(added[0]);
+            } else if (edit == "-" && fields >> name) {
+                a.remove_element(name);
+            } else if (edit == "~" && fields >> name >> type) {
+                element_type new_type{};
+                if (type.size() != 1 || !char_to_element_type(type[0], new_type)) {
+                    throw std::runtime_error{"unknown element type " + type};
+                }
+                a.retype_element(name, new_type);
+            } else {
+                throw std::runtime_error{"expected + element, - name or ~ name type"};
+            }
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error{std::string{e.what()} + " at edit line " + std::to_string(line_num)};
+        }
+    }
+}
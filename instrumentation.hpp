@@ -0,0 +1,195 @@
+#pragma once
+
+#include "range.hpp"
+#include <vector>
+#include <string>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <ios>
+#include <cstddef>
+
+/** \brief scoped phase timers for the analysis pipeline, written out as Chrome trace events
+    Phases only record anything while a recorder is active, otherwise a phase costs a single load
+    of the active recorder. Each phase reports its wall time, the heap allocations its thread made
+    meanwhile and any values attached to it, such as matrix dimensions. Allocations are counted
+    by whoever calls count_allocation(), e.g. a replaced operator new.
+*/
+namespace instrumentation {
+    struct event {
+        const char* name;
+        std::size_t thread;
+        double start;
+        double duration;
+        std::size_t allocations;
+        std::size_t allocated_bytes;
+        std::vector<std::pair<std::string, std::size_t>> values;
+    };
+
+    class recorder {
+    public:
+        recorder() : origin{std::chrono::steady_clock::now()} {}
+
+        recorder(const recorder&) = delete;
+        recorder& operator=(const recorder&) = delete;
+
+        /// @brief microseconds since the recorder was created
+        double now() const {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+        }
+
+        void add(event e) {
+            std::lock_guard<std::mutex> lock{mutex};
+            events.push_back(std::move(e));
+        }
+
+        /// @brief JSON object format of the trace event format, loadable by chrome://tracing and Perfetto
+        void write_trace(std::ostream& os) const {
+            std::lock_guard<std::mutex> lock{mutex};
+
+            const auto flags = os.flags();
+            const auto precision = os.precision(3);
+            os << std::fixed << "{\"traceEvents\": [";
+            for (const auto i : ext::range(0, events.size())) {
+                const auto& e = events[i];
+                os << (i == 0 ? "\n" : ",\n") << "{\"name\": \"" << e.name << "\", \"cat\": \"analysis\", \"ph\": \"X\""
+                    << ", \"pid\": 1, \"tid\": " << e.thread << ", \"ts\": " << e.start << ", \"dur\": " << e.duration
+                    << ", \"args\": {\"allocations\": " << e.allocations << ", \"allocated_bytes\": " << e.allocated_bytes;
+                for (const auto& value : e.values) os << ", \"" << value.first << "\": " << value.second;
+                os << "}}";
+            }
+            os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+            os.flags(flags);
+            os.precision(precision);
+        }
+
+    private:
+        const std::chrono::steady_clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<event> events;
+    };
+
+    struct allocation_counters {
+        std::size_t count;
+        std::size_t bytes;
+    };
+
+    /// @brief observers of storage that bypasses operator new, such as aligned matrix storage
+    struct storage_hooks {
+        void (*allocated)(void* ptr);
+        void (*released)(void* ptr);
+    };
+
+    namespace detail {
+        inline std::atomic<const storage_hooks*>& hooks() {
+            static std::atomic<const storage_hooks*> result{nullptr};
+            return result;
+        }
+
+        inline std::atomic<recorder*>& active() {
+            static std::atomic<recorder*> result{nullptr};
+            return result;
+        }
+
+        inline allocation_counters& thread_allocations() {
+            static thread_local allocation_counters result{};
+            return result;
+        }
+
+        /// @brief small dense number of the calling thread, used as the trace thread id
+        inline std::size_t thread_index() {
+            static std::atomic<std::size_t> next{};
+            static thread_local const std::size_t result{next++};
+            return result;
+        }
+    } /* namespace detail */
+
+    /// @brief phases are recorded into `r` until disable() is called
+    inline void enable(recorder& r) { detail::active() = &r; }
+    inline void disable() { detail::active() = nullptr; }
+
+    inline void count_allocation(const std::size_t bytes) {
+        auto& counters = detail::thread_allocations();
+        ++counters.count;
+        counters.bytes += bytes;
+    }
+
+    /// @brief `hooks` observe storage reported through count_storage() and release_storage(), nullptr for none
+    inline void set_storage_hooks(const storage_hooks* const hooks) { detail::hooks() = hooks; }
+
+    /// @brief counts storage not obtained through operator new, which counts itself if replaced
+    inline void count_storage(void* const ptr, const std::size_t bytes) {
+        count_allocation(bytes);
+        if (const auto hooks = detail::hooks().load(std::memory_order_relaxed)) hooks->allocated(ptr);
+    }
+
+    /// @brief to be called before storage reported through count_storage() is freed
+    inline void release_storage(void* const ptr) {
+        if (const auto hooks = detail::hooks().load(std::memory_order_relaxed)) hooks->released(ptr);
+    }
+
+    /// @brief times the enclosing scope as a phase nested in the phase open on the same thread, if any
+    class scoped_phase {
+    public:
+        explicit scoped_phase(const char* const name) : rec{detail::active().load(std::memory_order_relaxed)} {
+            if (!rec) return;
+
+            const auto& counters = detail::thread_allocations();
+            parent = innermost();
+            innermost() = this;
+            data.name = name;
+            data.thread = detail::thread_index();
+            data.allocations = counters.count;
+            data.allocated_bytes = counters.bytes;
+            data.start = rec->now();
+        }
+
+        ~scoped_phase() {
+            if (!rec) return;
+
+            const auto& counters = detail::thread_allocations();
+            data.duration = rec->now() - data.start;
+            data.allocations = counters.count - data.allocations;
+            data.allocated_bytes = counters.bytes - data.allocated_bytes;
+            innermost() = parent;
+            rec->add(std::move(data));
+        }
+
+        scoped_phase(const scoped_phase&) = delete;
+        scoped_phase& operator=(const scoped_phase&) = delete;
+
+        /// @brief attaches a value to the innermost phase open on the calling thread
+        static void annotate(const std::string& key, const std::size_t value) {
+            if (const auto phase = innermost()) phase->data.values.emplace_back(key, value);
+        }
+
+    private:
+        static scoped_phase*& innermost() {
+            static thread_local scoped_phase* result{};
+            return result;
+        }
+
+        recorder* const rec;
+        scoped_phase* parent;
+        event data;
+    };
+
+    /// @return f() evaluated within a phase, meant for member initializers
+    template<typename F> auto measure(const char* const name, F f) -> decltype(f()) {
+        const scoped_phase phase{name};
+        return f();
+    }
+
+    inline void annotate(const std::string& key, const std::size_t value) { scoped_phase::annotate(key, value); }
+
+    /// @brief reports the dimensions of a matrix under `<name>_rows`, `<name>_cols` and `<name>_nnz`
+    template<typename M> void annotate_matrix(const std::string& name, const M& m) {
+        if (!detail::active().load(std::memory_order_relaxed)) return;
+
+        annotate(name + "_rows", m.row_num());
+        annotate(name + "_cols", m.col_num());
+        annotate(name + "_nnz", m.nnz());
+    }
+} /* namespace instrumentation */
@@ -1,23 +1,223 @@
 #include "analysis.hpp"
+#include "batch.hpp"
+#include "equation_writer.hpp"
 #include "circuit_from_stream.hpp"
+#include "determinant_diagram.hpp"
+#include "incremental_analysis.hpp"
+#include "instrumentation.hpp"
+#include "mna.hpp"
+#include "transient.hpp"
 #include <iostream>
 #include <fstream>
+#include <chrono>
 #include <typeinfo>
+#include <memory>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+
+namespace {
+    /// @brief every heap allocation is attributed to the instrumentation phase open on the allocating thread
+    void* counted_allocate(const std::size_t size) {
+        instrumentation::count_allocation(size);
+        if (const auto ptr = std::malloc(size != 0 ? size : 1)) return ptr;
+        throw std::bad_alloc{};
+    }
+
+    void counted_free(void* const ptr) { std::free(ptr); }
+}
+
+void* operator new(const std::size_t size) { return counted_allocate(size); }
+void* operator new[](const std::size_t size) { return counted_allocate(size); }
+void operator delete(void* const ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr) noexcept { counted_free(ptr); }
+void operator delete(void* const ptr, std::size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* const ptr, std::size_t) noexcept { counted_free(ptr); }
+
+/// @brief reads start,stop,points_per_decade, frequencies may carry scale suffixes as element values do
+std::vector<double> parse_decade_sweep(const std::string& spec) {
+    double fields[3]{};
+    auto it = spec.data();
+    const auto last = spec.data() + spec.size();
+    for (auto& field : fields) {
+        const auto end = std::find(it, last, ',');
+        parse_value(it, end, field);
+        it = end != last ? end + 1 : last;
+    }
+
+    if (!(fields[2] >= 1.0)) throw std::runtime_error{"expected start,stop,points_per_decade after --ac"};
+    return decade_sweep(fields[0], fields[1], static_cast<std::size_t>(fields[2]));
+}
+
+/// @brief reads step,stop and an optional integration method, be, trap (the default) or bdf2
+transient_options parse_transient(const std::string& spec) {
+    double fields[2]{};
+    auto it = spec.data();
+    const auto last = spec.data() + spec.size();
+    for (auto& field : fields) {
+        const auto end = std::find(it, last, ',');
+        parse_value(it, end, field);
+        it = end != last ? end + 1 : last;
+    }
+
+    const std::string method{it, last};
+    if (method.empty() || method == "trap") return make_transient_options(fields[0], fields[1]);
+    if (method == "be") return make_transient_options(fields[0], fields[1], integration_method::backward_euler);
+    if (method == "bdf2") return make_transient_options(fields[0], fields[1], integration_method::bdf2);
+
+    throw std::runtime_error{"unknown integration method " + method + ", expected be, trap or bdf2"};
+}
+
+/// @brief reads input_source,output_node
+std::pair<std::string, std::size_t> parse_network_function(const std::string& spec) {
+    const auto comma = spec.find(',');
+    if (comma == std::string::npos || comma == 0 || comma + 1 == spec.size()) {
+        throw std::runtime_error{"expected input_source,output_node after --ddd"};
+    }
+
+    return { spec.substr(0, comma), std::stoul(spec.substr(comma + 1)) };
+}
 
 int main(int argc, char** argv) try {
-    if (argc < 2) {
-        throw std::runtime_error{"expected circuit file name as second argument"};
+    // main [-j thread_num] [--cache directory] [--trace output] [--to-binary output] file
+    // main [-j thread_num] [--trace output] --dc file
+    // main [-j thread_num] [--trace output] --ac start,stop,points_per_decade file
+    // main [--trace output] --tran step,stop[,be|trap|bdf2] file
+    // main [--trace output] --ddd input_source,output_node file
+    // main [--trace output] --edit script file
+    // main [-j thread_num] [--cache directory] [--trace output] --batch directory|manifest --out directory
+    std::size_t thread_num{};
+    std::string binary_path{}, batch_source{}, batch_output{}, cache_directory{}, trace_path{}, ac_sweep_spec{}, transient_spec{},
+        network_function_spec{}, edit_script{};
+    auto dc = false;
+    int arg{1};
+    while (arg < argc && argv[arg][0] == '-') {
+        const std::string option{argv[arg++]};
+        if (option == "--dc") {
+            dc = true;
+            continue;
+        }
+
+        if (arg >= argc) throw std::runtime_error{"expected value after " + option};
+        const auto value = argv[arg++];
+
+        if (option == "-j") thread_num = std::stoul(value);
+        else if (option == "--to-binary") binary_path = value;
+        else if (option == "--batch") batch_source = value;
+        else if (option == "--out") batch_output = value;
+        else if (option == "--cache") cache_directory = value;
+        else if (option == "--trace") trace_path = value;
+        else if (option == "--ac") ac_sweep_spec = value;
+        else if (option == "--tran") transient_spec = value;
+        else if (option == "--ddd") network_function_spec = value;
+        else if (option == "--edit") edit_script = value;
+        else throw std::runtime_error{"unknown option " + option};
+    }
+
+    // phases of the run are recorded as Chrome trace events, written out once the run completes
+    instrumentation::recorder recorder{};
+    if (!trace_path.empty()) instrumentation::enable(recorder);
+    const auto write_trace = [&trace_path, &recorder] {
+        if (trace_path.empty()) return;
+
+        instrumentation::disable();
+        std::ofstream os{trace_path};
+        if (!os) throw std::runtime_error{"could not open file " + trace_path};
+        recorder.write_trace(os);
+    };
+
+    // results are kept across runs in the cache directory, keyed by the canonical form of each component
+    std::unique_ptr<analysis_cache> cache{};
+    if (!cache_directory.empty()) cache.reset(new analysis_cache{256, cache_directory, true});
+
+    if (!batch_source.empty()) {
+        if (batch_output.empty()) throw std::runtime_error{"expected output directory after --out"};
+
+        const auto start = std::chrono::steady_clock::now();
+        thread_pool pool{thread_num != 0 ? thread_num : thread_pool::default_thread_num()};
+        const auto results = run_batch(list_netlists(batch_source), batch_output, pool, cache.get());
+
+        write_batch_summary(std::cout, results,
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        if (cache) std::cout << "cache: " << cache->hits() << " hits, " << cache->misses() << " misses\n";
+        write_trace();
+        return 0;
+    }
+
+    if (arg >= argc) {
+        throw std::runtime_error{"expected circuit file name as argument"};
+    }
+
+    const auto c = instrumentation::measure("parse", [&] {
+        if (thread_num == 0) return circuit_from_file(argv[arg]);
+
+        thread_pool pool{thread_num};
+        return circuit_from_file(argv[arg], pool);
+    });
+
+    if (!binary_path.empty()) {
+        std::ofstream os{binary_path, std::ios::binary};
+        if (!os) throw std::runtime_error{"could not open file " + binary_path};
+        circuit_to_binary(os, c);
+        write_trace();
+        return 0;
+    }
+
+    if (dc) {
+        const mna_layout layout{c};
+        write_solution(std::cout, c, layout, solve_dc(c, layout));
+        write_trace();
+        return 0;
+    }
+
+    if (!transient_spec.empty()) {
+        const mna_layout layout{c};
+        write_transient(std::cout, c, layout, parse_transient(transient_spec));
+        write_trace();
+        return 0;
+    }
+
+    // the circuit is analyzed once, then the script's edits are applied incrementally
+    if (!edit_script.empty()) {
+        std::ifstream is{edit_script};
+        if (!is) throw std::runtime_error{"could not open file " + edit_script};
+
+        incremental_analysis model{instrumentation::measure("analysis", [&c] { return incremental_analysis{c}; })};
+        instrumentation::measure("apply_edits", [&model, &is] { apply_edits(model, is); });
+
+        const auto system = model.get_model_equations();
+        equation_writer writer{std::cout, system.equations.get_symbols()};
+        emit_system(system, writer);
+        writer.finish();
+        std::cout << std::endl;
+        write_trace();
+        return 0;
+    }
+
+    if (!network_function_spec.empty()) {
+        const auto spec = parse_network_function(network_function_spec);
+        const analysis a{c};
+        write_network_function(std::cout, instrumentation::measure("network_function", [&] {
+            return make_network_function(a, spec.first, spec.second);
+        }));
+        write_trace();
+        return 0;
     }
 
-    std::ifstream in{argv[1]};
-    if (!in) {
-        throw std::runtime_error{"could not open file " + std::string{argv[1]}};
+    if (!ac_sweep_spec.empty()) {
+        const mna_layout layout{c};
+        thread_pool pool{thread_num != 0 ? thread_num : thread_pool::default_thread_num()};
+        write_ac_sweep(std::cout, c, layout, parse_decade_sweep(ac_sweep_spec), pool);
+        write_trace();
+        return 0;
     }
 
-    const auto c = circuit_from_stream(in);
-    const analysis<float> nodal_analyzer{c};
+    // independent islands are analyzed concurrently, each against its own reference node
+    thread_pool pool{thread_num != 0 ? thread_num : thread_pool::default_thread_num()};
+    write_model_equations(std::cout, c, &pool, cache.get());
 
-    std::cout << nodal_analyzer.get_model_equations() << std::endl;
+    std::cout << std::endl;
+    write_trace();
 } catch (const std::exception& e) {
     std::cerr << "exception of type " << typeid(e).name() << ": " << e.what() << std::endl;
 } catch (...) {
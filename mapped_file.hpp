@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// @brief read-only memory mapping of a whole file, an empty file maps to an empty range
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) : ptr{}, length{} {
+        const auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error{"could not open file " + path};
+
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error{"could not stat file " + path};
+        }
+
+        length = static_cast<std::size_t>(st.st_size);
+        if (length != 0) {
+            const auto mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error{"could not map file " + path};
+            }
+
+            ptr = static_cast<const char*>(mapping);
+            ::madvise(mapping, length, MADV_SEQUENTIAL);
+        }
+
+        ::close(fd);
+    }
+
+    ~mapped_file() {
+        if (ptr) ::munmap(const_cast<char*>(ptr), length);
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* begin() const { return ptr; }
+    const char* end() const { return ptr + length; }
+    std::size_t size() const { return length; }
+
+private:
+    const char* ptr;
+    std::size_t length;
+};
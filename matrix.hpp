@@ -2,162 +2,221 @@
 
 #include "relations.hpp"
 #include "range.hpp"
+#include "aligned_allocator.hpp"
+#include "row_kernels.hpp"
 #include <vector>
+#include <initializer_list>
+#include <type_traits>
 #include <algorithm>
 #include <stdexcept>
 #include <ostream>
 #include <cstddef>
 
-template<typename T, typename container> class row_view;
+template<typename T> class row_view;
 
+/** \brief dense row-major matrix backed by a single aligned buffer
+    Every row starts at a `alignment`-byte boundary, rows are `stride()` elements apart
+    and the padding between them is kept zero.
+*/
 template<typename T>
-class matrix : public std::vector<std::vector<T>> {
+class matrix {
 public:
-    using std::vector<std::vector<T>>::vector;
+    static constexpr std::size_t alignment = 32;
 
-    row_view<T, matrix<T>&> get_row(const std::size_t row) {
-        return row_view<T, matrix<T>&>{*this, row};
+    /// @brief number of elements per `alignment` bytes, row operations may start at any multiple of it
+    static constexpr std::size_t lanes() { return alignment % sizeof(T) == 0 ? alignment / sizeof(T) : 1; }
+
+    matrix() : matrix{0, 0} {}
+    matrix(const std::size_t row_num, const std::size_t col_num, const T value = T{})
+        : rows{row_num}, cols{col_num}, row_stride{padded_length(col_num)}
+        , storage(row_num * row_stride) {
+        if (value != T{}) {
+            for (const auto row : ext::range(0, rows)) std::fill_n((*this)[row], cols, value);
+        }
+    }
+
+    matrix(std::initializer_list<std::initializer_list<T>> init)
+        : matrix{init.size(), init.size() ? std::begin(init)->size() : 0} {
+        std::size_t row{};
+        for (const auto& items : init) {
+            if (items.size() != cols) throw std::runtime_error{"rows have different dimensions"};
+            std::copy(std::begin(items), std::end(items), (*this)[row++]);
+        }
+    }
+
+    std::size_t row_num() const { return rows; }
+    std::size_t col_num() const { return cols; }
+    std::size_t stride() const { return row_stride; }
+    bool empty() const { return rows == 0 || cols == 0; }
+
+    T* data() { return storage.data(); }
+    const T* data() const { return storage.data(); }
+
+    T* operator[](const std::size_t row) { return data() + row * row_stride; }
+    const T* operator[](const std::size_t row) const { return data() + row * row_stride; }
+
+    row_view<T> get_row(const std::size_t row) {
+        return { (*this)[row < rows ? row : throw std::runtime_error{"row out of bounds"}], cols };
     }
 
-    row_view<T, matrix<T>> get_row(const std::size_t row) const {
-        return row_view<T, matrix<T>>{*this, row};
+    row_view<const T> get_row(const std::size_t row) const {
+        return { (*this)[row < rows ? row : throw std::runtime_error{"row out of bounds"}], cols };
     }
 
     matrix<T> operator-() const {
         matrix<T> result{*this};
 
-        for (auto& row : result) {
-            for (auto& item : row) {
-                item = -item;
-            }
-        }
+        for (auto& item : result.storage) item = -item;
 
         return result;
     }
+
+private:
+    static std::size_t padded_length(const std::size_t length) {
+        return (length + lanes() - 1) / lanes() * lanes();
+    }
+
+    std::size_t rows;
+    std::size_t cols;
+    std::size_t row_stride;
+    std::vector<T, aligned_allocator<T, alignment>> storage;
 };
 
-template<typename T, typename container = matrix<T>&>
+template<typename T> constexpr std::size_t matrix<T>::alignment;
+
+/// @brief scaled row expression, lets `row -= other * el` update in place without a temporary row
+template<typename T>
+struct scaled_row {
+    const T* data;
+    std::size_t size;
+    T factor;
+};
+
+/// @brief non-owning view of a matrix row, `T` is const-qualified for rows of a const matrix
+template<typename T>
 class row_view {
 public:
-    row_view(container m, const std::size_t row)
-        : m(m), row{row < m.size() ? row : throw std::runtime_error{"row out of bounds"}} {}
+    using value_type = typename std::remove_const<T>::type;
 
-    T& operator[](const std::size_t col) { return m[row][col]; }
-    const T& operator[](const std::size_t col) const { return m[row][col]; }
+    row_view(T* const data, const std::size_t size) : ptr{data}, length{size} {}
 
-    std::size_t size() const { return m[row].size(); }
+    operator row_view<const T>() const { return { ptr, length }; }
 
-    row_view<T, matrix<T>> operator*(const T rhs) const {
-        row_view<T, matrix<T>> result{m, row};
-        return result *= rhs;
-    }
+    T& operator[](const std::size_t col) const { return ptr[col]; }
 
-    template<typename other_container>
-    row_view& operator=(const row_view<T, other_container>& rhs) {
-        if (size() != rhs.size()) throw std::runtime_error{"rows have different dimensions"};
+    T* data() const { return ptr; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + length; }
+    std::size_t size() const { return length; }
 
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] = rhs[index];
-        }
+    scaled_row<value_type> operator*(const value_type rhs) const { return { ptr, length, rhs }; }
+
+    template<typename U>
+    row_view& operator=(const row_view<U>& rhs) {
+        check_size(rhs.size());
+        std::copy(std::begin(rhs), std::end(rhs), ptr);
 
         return *this;
     }
 
-    template<typename other_container>
-    row_view& operator+=(const row_view<T, other_container>& rhs) {
-        if (size() != rhs.size()) throw std::runtime_error{"rows have different dimensions"};
+    template<typename U>
+    row_view& operator+=(const row_view<U>& rhs) {
+        check_size(rhs.size());
+        for (const auto index : ext::range(0, length)) ptr[index] += rhs[index];
 
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] += rhs[index];
-        }
+        return *this;
+    }
+
+    template<typename U>
+    row_view& operator-=(const row_view<U>& rhs) {
+        check_size(rhs.size());
+        for (const auto index : ext::range(0, length)) ptr[index] -= rhs[index];
 
         return *this;
     }
 
-    template<typename other_container>
-    row_view& operator-=(const row_view<T, other_container>& rhs) {
-        if (size() != rhs.size()) throw std::runtime_error{"rows have different dimensions"};
+    template<typename U>
+    row_view& operator*=(const row_view<U>& rhs) {
+        check_size(rhs.size());
+        for (const auto index : ext::range(0, length)) ptr[index] *= rhs[index];
 
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] -= rhs[index];
-        }
+        return *this;
+    }
+
+    template<typename U>
+    row_view& operator/=(const row_view<U>& rhs) {
+        check_size(rhs.size());
+        for (const auto index : ext::range(0, length)) ptr[index] /= rhs[index];
 
         return *this;
     }
 
-    template<typename other_container>
-    row_view& operator*=(const row_view<T, other_container>& rhs) {
-        if (size() != rhs.size()) throw std::runtime_error{"rows have different dimensions"};
+    row_view& operator+=(const scaled_row<value_type>& rhs) {
+        check_size(rhs.size);
+        kernels::axpy(ptr, rhs.data, rhs.factor, length);
 
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] *= rhs[index];
-        }
+        return *this;
+    }
+
+    row_view& operator-=(const scaled_row<value_type>& rhs) {
+        check_size(rhs.size);
+        kernels::axpy(ptr, rhs.data, -rhs.factor, length);
 
         return *this;
     }
 
-    template<typename other_container>
-    row_view& operator/=(const row_view<T, other_container>& rhs) {
-        if (size() != rhs.size()) throw std::runtime_error{"rows have different dimensions"};
+    row_view(const row_view&) = default;
 
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] /= rhs[index];
-        }
+    /// @brief assigns elements rather than rebinding the view
+    row_view& operator=(const row_view& rhs) {
+        check_size(rhs.size());
+        std::copy(std::begin(rhs), std::end(rhs), ptr);
 
         return *this;
     }
 
     void swap(row_view other) {
-        if (size() != other.size()) throw std::runtime_error{"rows have different dimensions"};
-
-        for (const auto index : ext::range(0, size())) {
-            std::swap((*this)[index], other[index]);
-        }
+        check_size(other.size());
+        kernels::swap(ptr, other.ptr, length);
     }
 
-    row_view& operator=(T rhs) {
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] = rhs;
-        }
+    row_view& operator=(const value_type rhs) {
+        std::fill_n(ptr, length, rhs);
 
         return *this;
     }
 
-    row_view& operator+=(T rhs) {
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] += rhs;
-        }
+    row_view& operator+=(const value_type rhs) {
+        for (auto& item : *this) item += rhs;
 
         return *this;
     }
 
-    row_view& operator-=(T rhs) {
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] -= rhs;
-        }
+    row_view& operator-=(const value_type rhs) {
+        for (auto& item : *this) item -= rhs;
 
         return *this;
     }
 
-    row_view& operator*=(T rhs) {
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] *= rhs;
-        }
+    row_view& operator*=(const value_type rhs) {
+        kernels::scale(ptr, rhs, length);
 
         return *this;
     }
 
-    row_view& operator/=(T rhs) {
-        for (const auto index : ext::range(0, size())) {
-            (*this)[index] /= rhs;
-        }
+    row_view& operator/=(const value_type rhs) {
+        kernels::divide(ptr, rhs, length);
 
         return *this;
     }
 
 private:
-    container m;
-    const std::size_t row;
+    void check_size(const std::size_t size) const {
+        if (length != size) throw std::runtime_error{"rows have different dimensions"};
+    }
+
+    T* ptr;
+    std::size_t length;
 };
 
 namespace std {
@@ -167,60 +226,57 @@ namespace std {
 
 template<typename T>
 inline matrix<T> reduce_last_row(const matrix<T>& m) {
-    if (m.size() < 2) throw std::logic_error{"reduce_last_row on a matrix with < 2 rows"};
+    if (m.row_num() < 2) throw std::logic_error{"reduce_last_row on a matrix with < 2 rows"};
 
-    return { std::begin(m), --std::end(m) };
+    return slice(m, m.row_num() - 1, m.col_num());
 }
 
 template<typename T>
 matrix<T> slice(const matrix<T>& m, const std::size_t row_num, const std::size_t col_num,
                 const std::size_t row_start = 0, const std::size_t col_start = 0) {
-    matrix<T> result{row_num};
+    if (row_start + row_num > m.row_num() || col_start + col_num > m.col_num()) {
+        throw std::runtime_error{"slice out of bounds"};
+    }
+
+    matrix<T> result{row_num, col_num};
 
     for (const auto i : ext::range(0, row_num)) {
-    	result[i].assign(std::begin(m[row_start + i]) + col_start, std::begin(m[row_start + i]) + col_start + col_num);
+        std::copy_n(m[row_start + i] + col_start, col_num, result[i]);
     }
 
     return result;
 }
 
 template<typename It>
-inline void augment_impl(It&, std::size_t) {}
+inline void augment_impl(It, std::size_t) {}
 template<typename It, typename Arg, typename... Args>
-inline void augment_impl(It& it, const std::size_t i, const matrix<Arg>& arg, const matrix<Args>&... args) {
-    std::copy(std::begin(arg[i]), std::end(arg[i]), it);
-    augment_impl(it, i, args...);
+inline void augment_impl(It it, const std::size_t i, const matrix<Arg>& arg, const matrix<Args>&... args) {
+    augment_impl(std::copy_n(arg[i], arg.col_num(), it), i, args...);
 }
 
 inline bool check_row_num(const std::size_t) { return true; }
 template<typename Arg, typename... Args>
 inline bool check_row_num(const std::size_t row_num, const matrix<Arg>& arg, const matrix<Args>&... args) {
-    return row_num == arg.size() ? check_row_num(row_num, args...) : false;
+    return row_num == arg.row_num() ? check_row_num(row_num, args...) : false;
 }
 
 inline std::size_t get_total_length() { return 0; }
 template<typename Arg, typename... Args>
 inline std::size_t get_total_length(const matrix<Arg>& arg, const matrix<Args>&... args) {
-    return arg.front().size() + get_total_length(args...);
+    return arg.col_num() + get_total_length(args...);
 }
 
 template<typename Arg, typename... Args>
 matrix<typename std::common_type<Arg, Args...>::type> augment(const matrix<Arg>& arg, const matrix<Args>&... args) {
-    const auto n = arg.size();
+    const auto n = arg.row_num();
     if (!check_row_num(n, args...)) {
         throw std::runtime_error{"cannot augment matrices with different number of rows"};
     }
 
     const auto m = get_total_length(arg, args...);
-    matrix<typename std::common_type<Arg, Args...>::type> result{n};
-
-    for (const auto i : ext::range(0, n)) {
-        auto& row = result[i];
-        row.reserve(m);
-        auto it = std::back_inserter(row);
+    matrix<typename std::common_type<Arg, Args...>::type> result{n, m};
 
-        augment_impl(it, i, arg, args...);
-    }
+    for (const auto i : ext::range(0, n)) augment_impl(result[i], i, arg, args...);
 
     return result;
 }
@@ -236,63 +292,151 @@ namespace {
     inline void gauss_elimination_handle_zero_row(continue_on_zero_row) {}
 }
 
+/// @brief first column a row operation needs to touch when columns before `col` are known to be zero
+template<typename T>
+inline std::size_t row_operation_start(const std::size_t col) {
+    return col - col % matrix<T>::lanes();
+}
+
+/** \brief forward pass of Gauss elimination, brings `m` to row echelon form with unit pivots
+    Row operations go through the in-place kernels and only cover the columns from the pivot
+    onwards (rounded down to a lane boundary) up to the zero padding at the end of each row.
+*/
 template<typename T, typename zero_row_policy>
 matrix<T> gauss_forward_elimination_impl(matrix<T> m) {
-    const auto row_num = m.size();
-	const auto col_num = m.front().size();
+    const auto row_num = m.row_num();
+	const auto col_num = m.col_num();
     if (row_num > col_num) {
         throw std::runtime_error{"the number of columns must be at least the number of rows"};
     }
+    if (row_num == 0) return m;
 
+    const auto stride = m.stride();
 	std::size_t row_start{};
 
 	for (const auto col : ext::range(0, col_num)) {
+        const auto first = row_operation_start<T>(col);
+        const auto length = stride - first;
+
         // try to ensure non-zero element at position `col` of the main diagonal
         if (is_equal(m[row_start][col], T{})) {
             for (const auto row : ext::range(row_start, row_num)) {
                 if (!is_equal(m[row][col], T{})) {
-                    std::swap(m.get_row(row_start), m.get_row(row));
+                    kernels::swap(m[row_start] + first, m[row] + first, length);
                     break;
                 }
             }
         }
 
+        const auto pivot_row = m[row_start] + first;
         const auto el = m[row_start][col];
         if (!is_equal(el, T{})) {
             // normalize row
-            m.get_row(row_start) /= el;
+            kernels::divide(pivot_row, el, length);
 
             // zero out all the rows below the main diagonal
             for (const auto row : ext::range(row_start + 1, row_num)) {
                 const auto el = m[row][col];
                 if (is_equal(el, T{})) continue;
 
-                m.get_row(row) -= m.get_row(row_start) * el;
+                kernels::axpy(m[row] + first, pivot_row, T{} - el, length);
             }
 
             if (++row_start == row_num) break;
         } else gauss_elimination_handle_zero_row(zero_row_policy{});
     }
 
-    return std::move(m);
+    return m;
 }
 
 template<typename T>
 void gauss_backward_elimination_impl(matrix<T>& m) {
-    const auto n = m.size();
+    const auto n = m.row_num();
+    const auto stride = m.stride();
 
     for (const auto col : ext::reverse_range(0, n)) {
+        const auto first = row_operation_start<T>(col);
+        const auto pivot_row = m[col] + first;
+
         for (const auto row : ext::reverse_range(0, col)) {
             const auto el = m[row][col];
             if (is_equal(el, T{})) continue;
 
-            m.get_row(row) -= m.get_row(col) * el;
+            kernels::axpy(m[row] + first, pivot_row, T{} - el, stride - first);
+        }
+    }
+}
+
+/** \brief fraction-free (Bareiss) elimination for integral matrices
+    Every intermediate entry is a minor of the input, so all divisions are exact and no precision is
+    lost. With `reduce` set, rows above the pivot are eliminated too (Gauss-Jordan), after which
+    every pivot equals the determinant of the pivot columns. Pivot columns are recorded in `pivots`.
+*/
+template<typename T, typename zero_row_policy>
+matrix<T> bareiss_elimination_impl(matrix<T> m, const bool reduce, std::vector<std::size_t>& pivots) {
+    const auto row_num = m.row_num();
+    const auto col_num = m.col_num();
+    if (row_num > col_num) {
+        throw std::runtime_error{"the number of columns must be at least the number of rows"};
+    }
+    if (row_num == 0) return m;
+
+    const auto stride = m.stride();
+    T previous{1};
+    std::size_t row_start{};
+
+    for (const auto col : ext::range(0, col_num)) {
+        // without reduction every row at or below row_start is zero left of `col`
+        const auto first = reduce ? 0 : row_operation_start<T>(col);
+        const auto length = stride - first;
+
+        if (m[row_start][col] == T{}) {
+            for (const auto row : ext::range(row_start + 1, row_num)) {
+                if (m[row][col] != T{}) {
+                    kernels::swap(m[row_start] + first, m[row] + first, length);
+                    break;
+                }
+            }
+        }
+
+        const auto pivot = m[row_start][col];
+        if (pivot == T{}) {
+            gauss_elimination_handle_zero_row(zero_row_policy{});
+            continue;
+        }
+
+        const auto pivot_row = m[row_start] + first;
+        for (const auto row : ext::range(reduce ? 0 : row_start + 1, row_num)) {
+            if (row == row_start) continue;
+
+            // rows with a zero in the pivot column still have to be rescaled by pivot / previous
+            const auto el = m[row][col];
+            if (el == T{} && pivot == previous) continue;
+
+            kernels::fraction_free_update(m[row] + first, pivot_row, pivot, el, previous, length);
         }
+
+        pivots.push_back(col);
+        previous = pivot;
+        if (++row_start == row_num) break;
     }
+
+    return m;
 }
 
+/// @brief divides the row by its pivot if the quotient is integral, returns whether it did
 template<typename T>
-inline matrix<T> gauss_elimination(const matrix<T>& m) {
+bool normalize_fraction_free_row(row_view<T> row, const T pivot) {
+    for (const auto item : row) {
+        if (item % pivot != T{}) return false;
+    }
+
+    row /= pivot;
+    return true;
+}
+
+template<typename T>
+matrix<T> gauss_elimination_impl(const matrix<T>& m, std::false_type) {
     auto forward_eliminated = gauss_forward_elimination_impl<T, throw_on_zero_row>(m);
     gauss_backward_elimination_impl(forward_eliminated);
 
@@ -300,28 +444,78 @@ inline matrix<T> gauss_elimination(const matrix<T>& m) {
 }
 
 template<typename T>
-inline matrix<T> echelonize(const matrix<T>& m) {
+matrix<T> gauss_elimination_impl(const matrix<T>& m, std::true_type) {
+    std::vector<std::size_t> pivots{};
+    auto reduced = bareiss_elimination_impl<T, throw_on_zero_row>(m, true, pivots);
+
+    for (const auto row : ext::range(0, pivots.size())) {
+        if (!normalize_fraction_free_row(reduced.get_row(row), reduced[row][pivots[row]])) {
+            throw std::runtime_error{"the solution is not integral"};
+        }
+    }
+
+    return reduced;
+}
+
+template<typename T>
+matrix<T> echelonize_impl(const matrix<T>& m, std::false_type) {
     return gauss_forward_elimination_impl<T, continue_on_zero_row>(m);
 }
 
+template<typename T>
+matrix<T> echelonize_impl(const matrix<T>& m, std::true_type) {
+    std::vector<std::size_t> pivots{};
+    auto echelon = bareiss_elimination_impl<T, continue_on_zero_row>(m, false, pivots);
+
+    for (const auto row : ext::range(0, pivots.size())) {
+        normalize_fraction_free_row(echelon.get_row(row), echelon[row][pivots[row]]);
+    }
+
+    return echelon;
+}
+
+/// @brief reduced row echelon form, exact (fraction-free) for integral T
+/// @throw std::runtime_error if the leading square part is singular or, for integral T, not unimodular over the rest
+template<typename T>
+inline matrix<T> gauss_elimination(const matrix<T>& m) {
+    return gauss_elimination_impl(m, std::is_integral<T>{});
+}
+
+/** \brief row echelon form
+    For floating-point T pivots are normalized to one. For integral T the form is fraction-free,
+    a row is normalized only when its pivot divides it, as is always the case for totally unimodular
+    matrices such as incidence submatrices.
+*/
+template<typename T>
+inline matrix<T> echelonize(const matrix<T>& m) {
+    return echelonize_impl(m, std::is_integral<T>{});
+}
+
 template<typename T>
 matrix<T> identity(const std::size_t n) {
-    matrix<T> result{n, std::vector<T>(n)};
+    matrix<T> result{n, n};
 
     for (const auto i : ext::range(0, n)) result[i][i] = T{1};
 
     return result;
 }
 
+/// @brief transposes tile by tile so that both the source rows and the destination rows stay in cache
 template<typename T>
 matrix<T> transpose(const matrix<T>& mat) {
-    const auto m = mat.size(), n = mat.front().size();
-
-    matrix<T> result{n, std::vector<T>(m)};
-
-    for (const auto i : ext::range(0, m)) {
-      for (const auto j : ext::range(0, n)) {
-            result[j][i] = mat[i][j];
+    const auto m = mat.row_num(), n = mat.col_num();
+    const std::size_t tile{32};
+
+    matrix<T> result{n, m};
+
+    for (std::size_t i0{}; i0 < m; i0 += tile) {
+        const auto i1 = std::min(i0 + tile, m);
+        for (std::size_t j0{}; j0 < n; j0 += tile) {
+            const auto j1 = std::min(j0 + tile, n);
+            for (const auto i : ext::range(i0, i1)) {
+                const auto row = mat[i];
+                for (const auto j : ext::range(j0, j1)) result[j][i] = row[j];
+            }
         }
     }
 
@@ -330,23 +524,74 @@ matrix<T> transpose(const matrix<T>& mat) {
 
 template<typename T>
 matrix<T> invert(const matrix<T>& m) {
-    const auto n = m.size();
+    const auto n = m.row_num();
     return slice(gauss_elimination(augment(m, identity<T>(n))), n, n, 0, n);
 }
 
+namespace {
+    /// rows of rhs per panel and columns of rhs per panel, a panel is sized to stay in L2
+    const std::size_t gemm_depth_block = 128;
+    const std::size_t gemm_width_block = 256;
+
+    /// @brief result[i] += sum over k of lhs[i][k] * rhs[k] for the given panel, skipping zero coefficients
+    template<typename T>
+    void gemm_panel(const matrix<T>& lhs, const matrix<T>& rhs, matrix<T>& result,
+                    const std::size_t k0, const std::size_t k1, const std::size_t j0, const std::size_t j1) {
+        const auto m = lhs.row_num();
+        const auto width = j1 - j0;
+
+        // register blocking: four result rows share every load of a rhs row
+        std::size_t i{};
+        for (; i + 4 <= m; i += 4) {
+            T* const rows[4]{ result[i] + j0, result[i + 1] + j0, result[i + 2] + j0, result[i + 3] + j0 };
+
+            for (const auto k : ext::range(k0, k1)) {
+                const T a[4]{ lhs[i][k], lhs[i + 1][k], lhs[i + 2][k], lhs[i + 3][k] };
+                // exact comparisons: the epsilon of is_zero would drop small but significant coefficients
+                const auto nonzero = (a[0] != T{}) + (a[1] != T{}) + (a[2] != T{}) + (a[3] != T{});
+                if (nonzero == 0) continue;
+
+                const auto rhs_row = rhs[k] + j0;
+                if (nonzero > 2) {
+                    kernels::axpy4(rows, a, rhs_row, width);
+                } else {
+                    for (const auto r : ext::range(0, 4)) {
+                        if (a[r] != T{}) kernels::axpy(rows[r], rhs_row, a[r], width);
+                    }
+                }
+            }
+        }
+
+        for (; i < m; ++i) {
+            const auto row = result[i] + j0;
+            for (const auto k : ext::range(k0, k1)) {
+                const auto el = lhs[i][k];
+                if (el != T{}) kernels::axpy(row, rhs[k] + j0, el, width);
+            }
+        }
+    }
+}
+
+/** \brief blocked matrix product
+    The product is accumulated panel by panel in i-k-j order, the innermost loop being a SIMD
+    row update. Zero coefficients of lhs are skipped, which makes products of sparse 0/±1
+    topology matrices considerably cheaper.
+*/
 template<typename T>
 matrix<T> operator*(const matrix<T>& lhs, const matrix<T>& rhs) {
-    const auto m = lhs.size(), n = lhs.front().size();
-    const auto p = rhs.size(), r = rhs.front().size();
+    const auto m = lhs.row_num(), n = lhs.col_num();
+    const auto p = rhs.row_num(), r = rhs.col_num();
 
     if (n != p) throw std::runtime_error{"inner dimensions of the matrix product operands do not match"};
 
-    matrix<T> result{m, std::vector<T>(r)};
-    for (const auto i : ext::range(0, m)) {
-        for (const auto j : ext::range(0, r)) {
-            for (const auto k : ext::range(0, n)) {
-                result[i][j] += lhs[i][k] * rhs[k][j];
-            }
+    matrix<T> result{m, r};
+    // rhs and result share the stride, the zero padding lets the last panel run without a scalar tail
+    const auto width = result.stride();
+
+    for (std::size_t k0{}; k0 < n; k0 += gemm_depth_block) {
+        const auto k1 = std::min(k0 + gemm_depth_block, n);
+        for (std::size_t j0{}; j0 < width; j0 += gemm_width_block) {
+            gemm_panel(lhs, rhs, result, k0, k1, j0, std::min(j0 + gemm_width_block, width));
         }
     }
 
@@ -357,9 +602,9 @@ template<typename T>
 std::ostream& operator<<(std::ostream& os, const matrix<T>& m) {
     os << "[\n";
 
-    for (const auto& row : m) {
+    for (const auto row : ext::range(0, m.row_num())) {
 		os << '\t';
-		for (const auto& elem : row) {
+		for (const auto& elem : m.get_row(row)) {
 			os << elem << '\t';
         }
 
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "circuit.hpp"
+#include "node_map.hpp"
+#include "disjoint_set.hpp"
+#include "sparse_matrix.hpp"
+#include "sparse_lu.hpp"
+#include "equation_writer.hpp"
+#include "thread_pool.hpp"
+#include "instrumentation.hpp"
+#include "range.hpp"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <complex>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+/** \brief unknowns of the numeric modified nodal analysis, the same as those of analysis::get_model_equations
+    Potentials of the nodes come first in node number order, then the currents through voltage-defined
+    elements in netlist order, whereas get_model_equations lists them in the branch order of its spanning tree.
+    Every connected component is referred to its highest numbered node, as with split_components,
+    and that node has no potential unknown.
+*/
+class mna_layout {
+public:
+    enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+    explicit mna_layout(const circuit& c) : nodes{c}, potentials(nodes.size(), none), currents(c.size(), none) {
+        tails.reserve(c.size());
+        heads.reserve(c.size());
+        disjoint_set components{nodes.size()};
+        for (const auto branch : ext::range(0, c.size())) {
+            tails.push_back(nodes.compact(c.tail(branch)));
+            heads.push_back(nodes.compact(c.head(branch)));
+            components.unite(tails.back(), heads.back());
+        }
+
+        // the highest node of a component is the last one seen when walking nodes in order
+        std::vector<std::size_t> reference(nodes.size(), none);
+        for (const auto node : ext::range(0, nodes.size())) reference[components.find(node)] = node;
+
+        for (const auto node : ext::range(0, nodes.size())) {
+            if (reference[components.find(node)] == node) continue;
+
+            potentials[node] = unknown_nodes.size();
+            unknown_nodes.push_back(node);
+        }
+
+        for (const auto branch : ext::range(0, c.size())) {
+            if (!c.is_voltage_defined(branch)) continue;
+
+            currents[branch] = unknown_nodes.size() + current_branches.size();
+            current_branches.push_back(branch);
+        }
+    }
+
+    std::size_t size() const { return unknown_nodes.size() + current_branches.size(); }
+    /// @brief unknowns [0, potential_num()) are node potentials, the others branch currents
+    std::size_t potential_num() const { return unknown_nodes.size(); }
+
+    /// @return unknown of the potential of the tail or head of a branch, none for a reference node
+    std::size_t tail_potential(const std::size_t branch) const { return potentials[tails[branch]]; }
+    std::size_t head_potential(const std::size_t branch) const { return potentials[heads[branch]]; }
+    /// @return unknown of the current through a branch, none unless the branch is voltage-defined
+    std::size_t current(const std::size_t branch) const { return currents[branch]; }
+
+    /// @brief writes the name of an unknown as write_unknown would, V_<node> or I_<element>
+    template<typename Stream> Stream& write_name(Stream& os, const circuit& c, const std::size_t index) const {
+        if (index < unknown_nodes.size()) return os << "V_" << static_cast<std::uint64_t>(nodes.original(unknown_nodes[index]));
+
+        const auto branch = current_branches[index - unknown_nodes.size()];
+        os << "I_";
+        os.write(c.name_data(branch), c.name_length(branch));
+        return os;
+    }
+
+private:
+    node_map nodes;
+    std::vector<std::size_t> tails, heads;
+    std::vector<std::size_t> potentials;
+    std::vector<std::size_t> currents;
+    std::vector<std::size_t> unknown_nodes;
+    std::vector<std::size_t> current_branches;
+};
+
+/// @brief A x = rhs, with A stored by columns as sparse_lu expects
+template<typename T> struct mna_system {
+    sparse_matrix<T> columns;
+    std::vector<T> rhs;
+};
+
+/** \brief calls stamp(row, col, g, c) for every entry of A(s) = G + s C and source(row, value) for the sources
+    Node rows are the KCL model equations, I_E + (V_tail - V_head) / R + C d(V_tail - V_head)/dt + J = 0
+    summed with the incidence signs. Voltage-defined rows are V_tail - V_head - E = 0 and
+    V_tail - V_head - L dI_L/dt = 0, derivatives becoming the factor s. Unknowns of a reference node
+    are none and produce no entry.
+*/
+template<typename Stamp, typename Source>
+void stamp_mna(const circuit& c, const mna_layout& layout, Stamp stamp, Source source) {
+    const auto stamp_entry = [&stamp] (const std::size_t row, const std::size_t col, const double g, const double c) {
+        if (row != mna_layout::none && col != mna_layout::none) stamp(row, col, g, c);
+    };
+    const auto stamp_admittance = [&stamp_entry] (const std::size_t tail, const std::size_t head, const double g,
+                                                  const double c) {
+        stamp_entry(tail, tail, g, c);
+        stamp_entry(tail, head, -g, -c);
+        stamp_entry(head, tail, -g, -c);
+        stamp_entry(head, head, g, c);
+    };
+    const auto add_source = [&source] (const std::size_t row, const double value) {
+        if (row != mna_layout::none) source(row, value);
+    };
+
+    for (const auto branch : ext::range(0, c.size())) {
+        const auto tail = layout.tail_potential(branch), head = layout.head_potential(branch);
+        const auto value = c.value(branch);
+
+        switch (c.type(branch)) {
+        case element_type::resistor:
+            if (value == 0.0) throw std::runtime_error{"resistor " + c.name(branch) + " has no resistance"};
+            stamp_admittance(tail, head, 1.0 / value, 0.0);
+            break;
+        case element_type::capacitor:
+            stamp_admittance(tail, head, 0.0, value);
+            break;
+        case element_type::current_source:
+            add_source(tail, -value);
+            add_source(head, value);
+            break;
+        case element_type::voltage_source:
+        case element_type::inductor: {
+            const auto current = layout.current(branch);
+            stamp_entry(tail, current, 1.0, 0.0);
+            stamp_entry(head, current, -1.0, 0.0);
+            stamp_entry(current, tail, 1.0, 0.0);
+            stamp_entry(current, head, -1.0, 0.0);
+            if (c.type(branch) == element_type::voltage_source) add_source(current, value);
+            else stamp_entry(current, current, 0.0, -value);
+            break;
+        }
+        }
+    }
+}
+
+/// @brief the DC operating point equations, A(0): capacitors leave no entry and inductors become shorts
+mna_system<double> assemble_dc(const circuit& c, const mna_layout& layout) {
+    const auto n = layout.size();
+    mna_system<double> result{ {}, std::vector<double>(n) };
+
+    std::vector<triplet<double>> entries{};
+    entries.reserve(4 * c.size());
+    // transposed on the way in, so that rows of the assembled matrix are columns of A
+    stamp_mna(c, layout,
+        [&entries] (const std::size_t row, const std::size_t col, const double g, double) {
+            if (g != 0.0) entries.push_back({ col, row, g });
+        },
+        [&result] (const std::size_t row, const double value) { result.rhs[row] += value; });
+
+    result.columns = from_triplets(n, n, entries);
+    return result;
+}
+
+/** \brief A(s) = G + s C by columns, G and C sharing one pattern so that every A(s) factors alike
+    An AC sweep takes the values of the sources as their amplitudes, all in phase, a transient
+    simulation as steps switched on at t = 0.
+*/
+struct mna_pencil {
+    sparse_matrix<double> g;
+    sparse_matrix<double> c;
+    std::vector<double> rhs;
+};
+
+mna_pencil assemble_pencil(const circuit& c, const mna_layout& layout) {
+    const auto n = layout.size();
+    mna_pencil result{ {0, n}, {0, n}, std::vector<double>(n) };
+
+    // G and C entries travel as the real and imaginary part, so duplicates of either are summed alike
+    std::vector<triplet<std::complex<double>>> entries{};
+    entries.reserve(4 * c.size());
+    stamp_mna(c, layout,
+        [&entries] (const std::size_t row, const std::size_t col, const double g, const double c) {
+            entries.push_back({ col, row, { g, c } });
+        },
+        [&result] (const std::size_t row, const double value) { result.rhs[row] += value; });
+
+    const auto combined = from_triplets(n, n, entries);
+    result.g.reserve(n, combined.nnz());
+    result.c.reserve(n, combined.nnz());
+    for (const auto i : ext::range(0, n)) {
+        result.g.add_row();
+        result.c.add_row();
+        for (const auto& e : combined.row(i)) {
+            result.g.push_back(e.col, e.value.real());
+            result.c.push_back(e.col, e.value.imag());
+        }
+    }
+
+    return result;
+}
+
+/// @return G + j omega C on the common pattern, by columns
+sparse_matrix<std::complex<double>> evaluate(const mna_pencil& system, const double angular_frequency) {
+    sparse_matrix<std::complex<double>> result{0, system.g.col_num()};
+    result.reserve(system.g.row_num(), system.g.nnz());
+    for (const auto i : ext::range(0, system.g.row_num())) {
+        result.add_row();
+        auto c = std::begin(system.c.row(i));
+        for (const auto& g : system.g.row(i)) {
+            result.push_back(g.col, { g.value, angular_frequency * c->value });
+            ++c;
+        }
+    }
+
+    return result;
+}
+
+/// @return G + a C on the common pattern, by columns, the matrix of a companion model of step coefficient a
+sparse_matrix<double> combine(const mna_pencil& system, const double a) {
+    sparse_matrix<double> result{0, system.g.col_num()};
+    result.reserve(system.g.row_num(), system.g.nnz());
+    for (const auto i : ext::range(0, system.g.row_num())) {
+        result.add_row();
+        auto c = std::begin(system.c.row(i));
+        for (const auto& g : system.g.row(i)) {
+            result.push_back(g.col, g.value + a * c->value);
+            ++c;
+        }
+    }
+
+    return result;
+}
+
+namespace detail {
+    /// @brief names the unknown a singular matrix got stuck on, `what` describes the failed analysis
+    [[noreturn]] inline void throw_singular(const circuit& c, const mna_layout& layout, const singular_matrix& e,
+                                     const std::string& what) {
+        std::ostringstream name{};
+        layout.write_name(static_cast<std::ostream&>(name), c, e.column);
+        throw std::runtime_error{what + ", the equations are singular in " + name.str() +
+            " (floating node, capacitor cut-set or loop of voltage sources and inductors?)"};
+    }
+} /* namespace detail */
+
+/// @return values of the unknowns of `layout` at the DC operating point
+std::vector<double> solve_dc(const circuit& c, const mna_layout& layout) {
+    const auto system = instrumentation::measure("mna_assembly", [&c, &layout] { return assemble_dc(c, layout); });
+
+    try {
+        const sparse_lu<double> lu{system.columns};
+        return instrumentation::measure("solve", [&lu, &system] { return lu.solve(system.rhs); });
+    } catch (const singular_matrix& e) {
+        detail::throw_singular(c, layout, e, "no DC operating point");
+    }
+}
+
+/// @brief one line per unknown: its name, as in the model equations, and its value
+void write_solution(std::ostream& os, const circuit& c, const mna_layout& layout, const std::vector<double>& values) {
+    buffered_writer out{os};
+    char digits[32];
+    for (const auto i : ext::range(0, layout.size())) {
+        layout.write_name(out, c, i) << " = ";
+        out.write(digits, std::snprintf(digits, sizeof(digits), "%.9g", values[i]));
+        out << '\n';
+    }
+}
+
+/// @return `points_per_decade` logarithmically spaced frequencies per decade, from `start` up to `stop`
+std::vector<double> decade_sweep(const double start, const double stop, const std::size_t points_per_decade) {
+    if (!(start > 0.0) || !(stop >= start) || points_per_decade == 0) {
+        throw std::runtime_error{"an AC sweep needs 0 < start <= stop and at least one point per decade"};
+    }
+
+    const auto count = static_cast<std::size_t>(std::log10(stop / start) * points_per_decade + 1e-9) + 1;
+    std::vector<double> result{};
+    result.reserve(count);
+    for (const auto k : ext::range(0, count)) {
+        result.push_back(start * std::pow(10.0, static_cast<double>(k) / points_per_decade));
+    }
+
+    return result;
+}
+
+/** \brief solves A(j 2 pi f) x = rhs for every frequency f and calls sink(index, x) in frequency order
+    Ordering and symbolic factorization happen once, at the middle frequency. Frequencies are then dealt
+    to the pool in chunks, every worker refactoring its own copy of the factors with the pivot sequence
+    kept; it only pivots anew where a kept pivot got too small. Results are handed over in blocks of
+    about `block_bytes`, so long sweeps of large circuits run in bounded memory.
+*/
+template<typename Sink>
+void ac_sweep(const circuit& c, const mna_layout& layout, const std::vector<double>& frequencies, thread_pool& pool,
+              Sink sink, const std::size_t block_bytes = std::size_t{64} << 20) {
+    using value_type = std::complex<double>;
+    if (frequencies.empty()) return;
+
+    const auto system = instrumentation::measure("mna_assembly", [&c, &layout] { return assemble_pencil(c, layout); });
+    const std::vector<value_type> rhs(std::begin(system.rhs), std::end(system.rhs));
+    const auto angular = [] (const double frequency) { return 2 * 3.14159265358979323846 * frequency; };
+    const auto singular = [&c, &layout] (const singular_matrix& e, const double frequency) {
+        std::ostringstream what{};
+        what << "no AC solution at " << frequency << " Hz";
+        detail::throw_singular(c, layout, e, what.str());
+    };
+
+    const auto reference = frequencies[frequencies.size() / 2];
+    const auto lu = instrumentation::measure("symbolic_factorization", [&] {
+        try {
+            return sparse_lu<value_type>{evaluate(system, angular(reference))};
+        } catch (const singular_matrix& e) {
+            singular(e, reference);
+            throw;
+        }
+    });
+
+    const auto workers = std::min(pool.size(), frequencies.size());
+    std::vector<sparse_lu<value_type>> factors(workers, lu);
+    const auto bytes_per_frequency = std::max<std::size_t>(1, layout.size() * sizeof(value_type));
+    const auto chunk_limit = std::max<std::size_t>(1, block_bytes / bytes_per_frequency / workers);
+
+    std::vector<std::vector<value_type>> results{};
+    for (std::size_t first{}; first < frequencies.size(); ) {
+        const auto remaining = frequencies.size() - first;
+        const auto chunk = std::min(chunk_limit, (remaining + workers - 1) / workers);
+        const auto block = std::min(remaining, chunk * workers);
+        results.resize(block);
+
+        parallel_for(pool, (block + chunk - 1) / chunk, [&] (const std::size_t worker) {
+            const instrumentation::scoped_phase phase{"frequency_chunk"};
+            const auto last = std::min(block, (worker + 1) * chunk);
+            auto& factor = factors[worker];
+
+            std::size_t repivoted{};
+            for (const auto i : ext::range(worker * chunk, last)) {
+                const auto frequency = frequencies[first + i];
+                try {
+                    if (!factor.refactor(evaluate(system, angular(frequency)))) ++repivoted;
+                } catch (const singular_matrix& e) {
+                    singular(e, frequency);
+                }
+                results[i] = factor.solve(rhs);
+            }
+
+            instrumentation::annotate("frequencies", last - worker * chunk);
+            instrumentation::annotate("repivoted", repivoted);
+        });
+
+        for (const auto i : ext::range(0, block)) sink(first + i, results[i]);
+        first += block;
+    }
+}
+
+/// @brief tab separated table, a header naming the unknowns, then a line per frequency with values as re+imj
+void write_ac_sweep(std::ostream& os, const circuit& c, const mna_layout& layout, const std::vector<double>& frequencies,
+                    thread_pool& pool) {
+    buffered_writer out{os};
+    out << "frequency";
+    for (const auto i : ext::range(0, layout.size())) layout.write_name(out << '\t', c, i);
+    out << '\n';
+
+    char digits[64];
+    ac_sweep(c, layout, frequencies, pool,
+        [&] (const std::size_t index, const std::vector<std::complex<double>>& values) {
+            out.write(digits, std::snprintf(digits, sizeof(digits), "%.9g", frequencies[index]));
+            for (const auto& value : values) {
+                out.write(digits, std::snprintf(digits, sizeof(digits), "\t%.9g%+.9gj", value.real(), value.imag()));
+            }
+            out << '\n';
+        });
+}
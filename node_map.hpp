@@ -0,0 +1,58 @@
+#pragma once
+
+#include "circuit.hpp"
+#include "range.hpp"
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+
+/** \brief order-preserving bijection between the node numbers used by a netlist and a dense range
+    Compact numbers follow the order of the original ones, so the highest numbered node, which
+    serves as the reference node, stays the last one. Lookups in both directions need no more
+    memory than the list of nodes actually in use.
+*/
+class node_map {
+public:
+    node_map() = default;
+
+    explicit node_map(const circuit& c) {
+        nodes.reserve(2 * c.size());
+        nodes.insert(std::end(nodes), std::begin(c.get_tails()), std::end(c.get_tails()));
+        nodes.insert(std::end(nodes), std::begin(c.get_heads()), std::end(c.get_heads()));
+
+        std::sort(std::begin(nodes), std::end(nodes));
+        nodes.erase(std::unique(std::begin(nodes), std::end(nodes)), std::end(nodes));
+        nodes.shrink_to_fit();
+    }
+
+    std::size_t size() const { return nodes.size(); }
+
+    /// @return true if the netlist already numbers its nodes 0, 1, ..., size() - 1
+    bool is_identity() const { return nodes.empty() || nodes.back() == nodes.size() - 1; }
+
+    std::size_t original(const std::size_t compact) const { return nodes[compact]; }
+
+    std::size_t compact(const std::size_t original) const {
+        const auto it = std::lower_bound(std::begin(nodes), std::end(nodes), original);
+        if (it == std::end(nodes) || *it != original) {
+            throw std::out_of_range{"node " + std::to_string(original) + " is not in the circuit"};
+        }
+
+        return it - std::begin(nodes);
+    }
+
+    /// @return copy of the circuit with its nodes renumbered into the compact range
+    circuit apply(circuit c) const {
+        if (is_identity()) return c;
+
+        for (const auto i : ext::range(0, c.size())) c.set_nodes(i, compact(c.tail(i)), compact(c.head(i)));
+
+        return c;
+    }
+
+private:
+    std::vector<std::size_t> nodes;
+};
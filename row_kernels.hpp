@@ -0,0 +1,248 @@
+#pragma once
+
+#include "range.hpp"
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** \brief in-place row operations used by elimination and matrix products
+    The generic templates are plain loops, float and double overloads use AVX (with FMA when
+    available) or SSE2 depending on the target the translation unit is compiled for. The default
+    x86-64 build is SSE2, the AVX paths need e.g. make ARCH_FLAGS="-mavx2 -mfma".
+    None of the kernels allocate, pointers need not be aligned.
+*/
+namespace kernels {
+    /// @brief y += a * x
+    template<typename T> inline void axpy(T* const y, const T* const x, const T a, const std::size_t n) {
+        for (const auto i : ext::range(0, n)) y[i] += a * x[i];
+    }
+
+    /// @brief y *= a
+    template<typename T> inline void scale(T* const y, const T a, const std::size_t n) {
+        for (const auto i : ext::range(0, n)) y[i] *= a;
+    }
+
+    /// @brief y /= a
+    template<typename T> inline void divide(T* const y, const T a, const std::size_t n) {
+        for (const auto i : ext::range(0, n)) y[i] /= a;
+    }
+
+    template<typename T> inline void swap(T* const x, T* const y, const std::size_t n) {
+        std::swap_ranges(x, x + n, y);
+    }
+
+    /** \brief fraction-free row update y = (p * y - f * x) / d of Bareiss elimination, the division is exact
+        The common d = ±1 case of totally unimodular matrices needs neither division nor widening
+        and is left to the auto-vectorizer, otherwise products are formed in at least long long.
+    */
+    template<typename T> inline void fraction_free_update(T* const y, const T* const x,
+                                                          const T p, const T f, const T d, const std::size_t n) {
+        if (d == T{1}) {
+            for (const auto i : ext::range(0, n)) y[i] = p * y[i] - f * x[i];
+        } else if (d == T{} - T{1}) {
+            for (const auto i : ext::range(0, n)) y[i] = f * x[i] - p * y[i];
+        } else {
+            using wide = typename std::common_type<T, long long>::type;
+            for (const auto i : ext::range(0, n)) {
+                y[i] = static_cast<T>((static_cast<wide>(p) * y[i] - static_cast<wide>(f) * x[i]) / d);
+            }
+        }
+    }
+
+    /// @brief y[r] += a[r] * x for four rows at once, x is loaded once per step for all of them
+    template<typename T> inline void axpy4(T* const* const y, const T* const a, const T* const x, const std::size_t n) {
+        for (const auto i : ext::range(0, n)) {
+            const auto xi = x[i];
+            y[0][i] += a[0] * xi;
+            y[1][i] += a[1] * xi;
+            y[2][i] += a[2] * xi;
+            y[3][i] += a[3] * xi;
+        }
+    }
+
+    inline void axpy(double* const y, const double* const x, const double a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_pd(a);
+        for (; i + 4 <= n; i += 4) {
+#if defined(__FMA__)
+            _mm256_storeu_pd(y + i, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i)));
+#else
+            _mm256_storeu_pd(y + i, _mm256_add_pd(_mm256_loadu_pd(y + i), _mm256_mul_pd(va, _mm256_loadu_pd(x + i))));
+#endif
+        }
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_pd(a);
+        for (; i + 2 <= n; i += 2) {
+            _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+        }
+#endif
+        for (; i < n; ++i) y[i] += a * x[i];
+    }
+
+    inline void axpy(float* const y, const float* const x, const float a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8) {
+#if defined(__FMA__)
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+#else
+            _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(va, _mm256_loadu_ps(x + i))));
+#endif
+        }
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_ps(a);
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+        }
+#endif
+        for (; i < n; ++i) y[i] += a * x[i];
+    }
+
+    inline void scale(double* const y, const double a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_pd(a);
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(y + i, _mm256_mul_pd(_mm256_loadu_pd(y + i), va));
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_pd(a);
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(y + i, _mm_mul_pd(_mm_loadu_pd(y + i), va));
+#endif
+        for (; i < n; ++i) y[i] *= a;
+    }
+
+    inline void scale(float* const y, const float a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_loadu_ps(y + i), va));
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_ps(a);
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(y + i), va));
+#endif
+        for (; i < n; ++i) y[i] *= a;
+    }
+
+    inline void divide(double* const y, const double a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_pd(a);
+        for (; i + 4 <= n; i += 4) _mm256_storeu_pd(y + i, _mm256_div_pd(_mm256_loadu_pd(y + i), va));
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_pd(a);
+        for (; i + 2 <= n; i += 2) _mm_storeu_pd(y + i, _mm_div_pd(_mm_loadu_pd(y + i), va));
+#endif
+        for (; i < n; ++i) y[i] /= a;
+    }
+
+    inline void divide(float* const y, const float a, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const auto va = _mm256_set1_ps(a);
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_div_ps(_mm256_loadu_ps(y + i), va));
+#elif defined(__SSE2__)
+        const auto va = _mm_set1_ps(a);
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_div_ps(_mm_loadu_ps(y + i), va));
+#endif
+        for (; i < n; ++i) y[i] /= a;
+    }
+
+    inline void swap(double* const x, double* const y, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        for (; i + 4 <= n; i += 4) {
+            const auto vx = _mm256_loadu_pd(x + i);
+            _mm256_storeu_pd(x + i, _mm256_loadu_pd(y + i));
+            _mm256_storeu_pd(y + i, vx);
+        }
+#elif defined(__SSE2__)
+        for (; i + 2 <= n; i += 2) {
+            const auto vx = _mm_loadu_pd(x + i);
+            _mm_storeu_pd(x + i, _mm_loadu_pd(y + i));
+            _mm_storeu_pd(y + i, vx);
+        }
+#endif
+        for (; i < n; ++i) std::swap(x[i], y[i]);
+    }
+
+    inline void swap(float* const x, float* const y, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        for (; i + 8 <= n; i += 8) {
+            const auto vx = _mm256_loadu_ps(x + i);
+            _mm256_storeu_ps(x + i, _mm256_loadu_ps(y + i));
+            _mm256_storeu_ps(y + i, vx);
+        }
+#elif defined(__SSE2__)
+        for (; i + 4 <= n; i += 4) {
+            const auto vx = _mm_loadu_ps(x + i);
+            _mm_storeu_ps(x + i, _mm_loadu_ps(y + i));
+            _mm_storeu_ps(y + i, vx);
+        }
+#endif
+        for (; i < n; ++i) std::swap(x[i], y[i]);
+    }
+
+    inline void axpy4(double* const* const y, const double* const a, const double* const x, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const __m256d va[4]{ _mm256_set1_pd(a[0]), _mm256_set1_pd(a[1]), _mm256_set1_pd(a[2]), _mm256_set1_pd(a[3]) };
+        for (; i + 4 <= n; i += 4) {
+            const auto vx = _mm256_loadu_pd(x + i);
+            for (const auto r : ext::range(0, 4)) {
+#if defined(__FMA__)
+                _mm256_storeu_pd(y[r] + i, _mm256_fmadd_pd(va[r], vx, _mm256_loadu_pd(y[r] + i)));
+#else
+                _mm256_storeu_pd(y[r] + i, _mm256_add_pd(_mm256_loadu_pd(y[r] + i), _mm256_mul_pd(va[r], vx)));
+#endif
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128d va[4]{ _mm_set1_pd(a[0]), _mm_set1_pd(a[1]), _mm_set1_pd(a[2]), _mm_set1_pd(a[3]) };
+        for (; i + 2 <= n; i += 2) {
+            const auto vx = _mm_loadu_pd(x + i);
+            for (const auto r : ext::range(0, 4)) {
+                _mm_storeu_pd(y[r] + i, _mm_add_pd(_mm_loadu_pd(y[r] + i), _mm_mul_pd(va[r], vx)));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            for (const auto r : ext::range(0, 4)) y[r][i] += a[r] * x[i];
+        }
+    }
+
+    inline void axpy4(float* const* const y, const float* const a, const float* const x, const std::size_t n) {
+        std::size_t i{};
+#if defined(__AVX__)
+        const __m256 va[4]{ _mm256_set1_ps(a[0]), _mm256_set1_ps(a[1]), _mm256_set1_ps(a[2]), _mm256_set1_ps(a[3]) };
+        for (; i + 8 <= n; i += 8) {
+            const auto vx = _mm256_loadu_ps(x + i);
+            for (const auto r : ext::range(0, 4)) {
+#if defined(__FMA__)
+                _mm256_storeu_ps(y[r] + i, _mm256_fmadd_ps(va[r], vx, _mm256_loadu_ps(y[r] + i)));
+#else
+                _mm256_storeu_ps(y[r] + i, _mm256_add_ps(_mm256_loadu_ps(y[r] + i), _mm256_mul_ps(va[r], vx)));
+#endif
+            }
+        }
+#elif defined(__SSE2__)
+        const __m128 va[4]{ _mm_set1_ps(a[0]), _mm_set1_ps(a[1]), _mm_set1_ps(a[2]), _mm_set1_ps(a[3]) };
+        for (; i + 4 <= n; i += 4) {
+            const auto vx = _mm_loadu_ps(x + i);
+            for (const auto r : ext::range(0, 4)) {
+                _mm_storeu_ps(y[r] + i, _mm_add_ps(_mm_loadu_ps(y[r] + i), _mm_mul_ps(va[r], vx)));
+            }
+        }
+#endif
+        for (; i < n; ++i) {
+            for (const auto r : ext::range(0, 4)) y[r][i] += a[r] * x[i];
+        }
+    }
+} /* namespace kernels */
@@ -0,0 +1,497 @@
+#pragma once
+
+#include "sparse_matrix.hpp"
+#include "instrumentation.hpp"
+#include "range.hpp"
+#include <vector>
+#include <string>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <stdexcept>
+#include <cstddef>
+
+/// @brief thrown when no usable pivot is left for a column, `column` is its index in the matrix
+struct singular_matrix : std::runtime_error {
+    explicit singular_matrix(const std::size_t column)
+        : std::runtime_error{"matrix is singular in column " + std::to_string(column)}, column{column} {}
+
+    std::size_t column;
+};
+
+namespace detail {
+    /** \brief approximate minimum degree ordering on the quotient graph
+        Eliminating a variable turns it into an element whose members are its remaining neighbours,
+        elements adjacent to it are absorbed into the new one, so the graph never grows beyond its
+        initial size. Degrees are bounded from above as in AMD: |A_i| + |L_p \ i| + sum of |L_e \ L_p|
+        over the other elements of i. Elements found to lie within L_p are absorbed right away.
+        Dense variables, adjacent to more than 10 sqrt(n) others, are ordered last as AMD does.
+    */
+    class minimum_degree {
+    public:
+        explicit minimum_degree(std::vector<std::vector<std::size_t>> adjacency)
+            : n{adjacency.size()}, vars(std::move(adjacency)), elems(n), members(n), state(n, variable)
+            , degree(n), head(n + 1, none), next(n, none), prev(n, none), mark(n), weight(n), weight_tag(n)
+            , tag{}, min_degree{}, remaining{n} {}
+
+        std::vector<std::size_t> order() {
+            const auto dense = std::max<std::size_t>(16, static_cast<std::size_t>(10 * std::sqrt(static_cast<double>(n))));
+
+            std::vector<std::size_t> result{}, dense_vars{};
+            result.reserve(n);
+            for (const auto i : ext::range(0, n)) {
+                if (vars[i].size() > dense) {
+                    state[i] = dense_variable;
+                    dense_vars.push_back(i);
+                    --remaining;
+                }
+            }
+
+            for (const auto i : ext::range(0, n)) {
+                if (state[i] != variable) continue;
+
+                auto& adjacent = vars[i];
+                adjacent.erase(std::remove_if(std::begin(adjacent), std::end(adjacent),
+                    [this, i] (const std::size_t v) { return v == i || state[v] != variable; }), std::end(adjacent));
+                insert(i, adjacent.size());
+            }
+
+            while (result.size() + dense_vars.size() < n) {
+                while (head[min_degree] == none) ++min_degree;
+
+                const auto pivot = head[min_degree];
+                remove(pivot);
+                eliminate(pivot);
+                result.push_back(pivot);
+            }
+
+            result.insert(std::end(result), std::begin(dense_vars), std::end(dense_vars));
+            return result;
+        }
+
+    private:
+        enum variable_state : unsigned char { variable, dense_variable, element, absorbed };
+        enum : std::size_t { none = static_cast<std::size_t>(-1) };
+
+        void insert(const std::size_t i, const std::size_t d) {
+            degree[i] = d;
+            prev[i] = none;
+            next[i] = head[d];
+            if (head[d] != none) prev[head[d]] = i;
+            head[d] = i;
+            min_degree = std::min(min_degree, d);
+        }
+
+        void remove(const std::size_t i) {
+            if (prev[i] != none) next[prev[i]] = next[i];
+            else head[degree[i]] = next[i];
+            if (next[i] != none) prev[next[i]] = prev[i];
+        }
+
+        void absorb(const std::size_t e) {
+            state[e] = absorbed;
+            std::vector<std::size_t>{}.swap(members[e]);
+        }
+
+        void eliminate(const std::size_t pivot) {
+            ++tag;
+            state[pivot] = element;
+            mark[pivot] = tag;
+            --remaining;
+
+            // L_p: the pivot's variable neighbours and the members of its elements
+            std::vector<std::size_t> lp{};
+            for (const auto v : vars[pivot]) {
+                if (state[v] == variable && mark[v] != tag) {
+                    mark[v] = tag;
+                    lp.push_back(v);
+                }
+            }
+            for (const auto e : elems[pivot]) {
+                if (state[e] != element) continue;
+
+                for (const auto v : members[e]) {
+                    if (state[v] == variable && mark[v] != tag) {
+                        mark[v] = tag;
+                        lp.push_back(v);
+                    }
+                }
+                absorb(e);
+            }
+            std::vector<std::size_t>{}.swap(vars[pivot]);
+            std::vector<std::size_t>{}.swap(elems[pivot]);
+
+            // weight[e] becomes |L_e \ L_p| for every element adjacent to L_p
+            for (const auto i : lp) {
+                for (const auto e : elems[i]) {
+                    if (state[e] != element) continue;
+                    if (weight_tag[e] != tag) {
+                        weight_tag[e] = tag;
+                        weight[e] = members[e].size();
+                    }
+                    --weight[e];
+                }
+            }
+
+            for (const auto i : lp) {
+                remove(i);
+
+                std::size_t external{};
+                auto& adjacent_elems = elems[i];
+                adjacent_elems.erase(std::remove_if(std::begin(adjacent_elems), std::end(adjacent_elems),
+                    [&] (const std::size_t e) {
+                        if (state[e] != element) return true;
+                        if (weight[e] == 0) {
+                            absorb(e);
+                            return true;
+                        }
+
+                        external += weight[e];
+                        return false;
+                    }), std::end(adjacent_elems));
+                adjacent_elems.push_back(pivot);
+
+                // neighbours in L_p are now reached through the new element
+                auto& adjacent = vars[i];
+                adjacent.erase(std::remove_if(std::begin(adjacent), std::end(adjacent),
+                    [this] (const std::size_t v) { return state[v] != variable || mark[v] == tag; }), std::end(adjacent));
+
+                const auto bound = std::min(degree[i] + lp.size(), remaining - 1);
+                insert(i, std::min(adjacent.size() + lp.size() - 1 + external, bound));
+            }
+
+            members[pivot] = std::move(lp);
+        }
+
+        const std::size_t n;
+        std::vector<std::vector<std::size_t>> vars;
+        std::vector<std::vector<std::size_t>> elems;
+        std::vector<std::vector<std::size_t>> members;
+        std::vector<variable_state> state;
+        /// degree lists: head[d] is the first variable of degree d
+        std::vector<std::size_t> degree, head, next, prev;
+        std::vector<std::size_t> mark, weight, weight_tag;
+        std::size_t tag;
+        std::size_t min_degree;
+        /// variables neither eliminated nor dense
+        std::size_t remaining;
+    };
+} /* namespace detail */
+
+/// @brief fill-reducing symmetric permutation for the pattern of A + A^T of a square matrix
+template<typename T>
+std::vector<std::size_t> minimum_degree_order(const sparse_matrix<T>& a) {
+    if (a.row_num() != a.col_num()) throw std::logic_error{"minimum_degree_order needs a square matrix"};
+
+    const auto at = transpose(a);
+    std::vector<std::vector<std::size_t>> adjacency(a.row_num());
+    for (const auto i : ext::range(0, a.row_num())) {
+        auto& adjacent = adjacency[i];
+        adjacent.reserve(a.row(i).size() + at.row(i).size());
+        for (const auto& e : a.row(i)) adjacent.push_back(e.col);
+        for (const auto& e : at.row(i)) adjacent.push_back(e.col);
+
+        std::sort(std::begin(adjacent), std::end(adjacent));
+        adjacent.erase(std::unique(std::begin(adjacent), std::end(adjacent)), std::end(adjacent));
+    }
+
+    return detail::minimum_degree{std::move(adjacency)}.order();
+}
+
+/** \brief sparse LU factorization P A Q = L U with threshold partial pivoting
+    Left-looking (Gilbert-Peierls): column k of L and U comes from a sparse triangular solve with the
+    columns already computed, whose pattern is found by a depth-first search, so the work is
+    proportional to the arithmetic. Columns are taken in the order Q, by default minimum_degree_order;
+    the diagonal entry is preferred as pivot unless it is smaller than `pivot_tolerance` times the
+    largest candidate, which keeps the fill-reducing order for structurally symmetric matrices.
+    The matrix is passed by columns: row j of `columns` holds column j of A, i.e. A^T in CSR form.
+*/
+template<typename T>
+class sparse_lu {
+public:
+    explicit sparse_lu(const sparse_matrix<T>& columns, const double pivot_tolerance = 0.1)
+        : sparse_lu{columns, instrumentation::measure("ordering", [&columns] { return minimum_degree_order(columns); }),
+                    pivot_tolerance} {}
+
+    sparse_lu(const sparse_matrix<T>& columns, std::vector<std::size_t> column_order, const double pivot_tolerance = 0.1)
+        : n{columns.row_num()}, q(std::move(column_order)), pinv(n, none) {
+        if (columns.row_num() != columns.col_num() || q.size() != n) {
+            throw std::logic_error{"sparse_lu needs a square matrix and a column order of its size"};
+        }
+
+        const instrumentation::scoped_phase phase{"factorization"};
+        factor(columns, pivot_tolerance);
+        instrumentation::annotate("l_nnz", l_nnz());
+        instrumentation::annotate("u_nnz", u_nnz());
+    }
+
+    /** \brief numeric factorization of a matrix with the pattern of the one factored before
+        Reuses the pivot sequence and the patterns of L and U, so no search and no pivoting is done,
+        as when the values of a circuit change but not its topology. Should a reused pivot fall below
+        `pivot_tolerance` times the largest candidate of its column, the matrix is factored anew
+        with the same column order.
+        @return whether the pivot sequence could be reused
+    */
+    bool refactor(const sparse_matrix<T>& columns, const double pivot_tolerance = 0.1) {
+        if (columns.row_num() != n || columns.col_num() != n) {
+            throw std::logic_error{"refactor needs a matrix of the size factored before"};
+        }
+
+        if (refactor_numeric(columns, pivot_tolerance)) return true;
+
+        factor(columns, pivot_tolerance);
+        return false;
+    }
+
+    std::size_t size() const { return n; }
+    std::size_t l_nnz() const { return l_rows.size(); }
+    std::size_t u_nnz() const { return u_rows.size(); }
+    const std::vector<std::size_t>& get_column_order() const { return q; }
+
+    /// @return x such that A x = b
+    std::vector<T> solve(const std::vector<T>& b) const {
+        if (b.size() != n) throw std::logic_error{"right-hand side size does not match the matrix"};
+
+        std::vector<T> y(n);
+        for (const auto i : ext::range(0, n)) y[pinv[i]] = b[i];
+
+        for (const auto k : ext::range(0, n)) {
+            const auto yk = y[k];
+            for (const auto p : ext::range(l_offsets[k] + 1, l_offsets[k + 1])) y[l_rows[p]] -= l_values[p] * yk;
+        }
+
+        for (const auto k : ext::reverse_range(0, n)) {
+            const auto diagonal = u_offsets[k + 1] - 1;
+            y[k] /= u_values[diagonal];
+
+            const auto yk = y[k];
+            for (const auto p : ext::range(u_offsets[k], diagonal)) y[u_rows[p]] -= u_values[p] * yk;
+        }
+
+        std::vector<T> x(n);
+        for (const auto k : ext::range(0, n)) x[q[k]] = y[k];
+
+        return x;
+    }
+
+private:
+    static const std::size_t none = static_cast<std::size_t>(-1);
+
+    /// @return false if a pivot turned out too small, the factors are left invalid then
+    bool refactor_numeric(const sparse_matrix<T>& a, const double pivot_tolerance) {
+        // x is indexed by pivot position, as are the rows of L and U once factor() finished
+        std::vector<T> x(n);
+
+        for (const auto k : ext::range(0, n)) {
+            for (const auto& e : a.row(q[k])) x[pinv[e.col]] = e.value;
+
+            // rows of U(:, k) are in the topological order they were found in
+            const auto diagonal = u_offsets[k + 1] - 1;
+            for (const auto p : ext::range(u_offsets[k], diagonal)) {
+                const auto j = u_rows[p];
+                const auto xj = x[j];
+                u_values[p] = xj;
+                x[j] = T{};
+                for (const auto l : ext::range(l_offsets[j] + 1, l_offsets[j + 1])) x[l_rows[l]] -= l_values[l] * xj;
+            }
+
+            const auto pivot = x[k];
+            x[k] = T{};
+            double largest{std::abs(pivot)};
+            for (const auto l : ext::range(l_offsets[k] + 1, l_offsets[k + 1])) {
+                largest = std::max<double>(largest, std::abs(x[l_rows[l]]));
+            }
+            if (!(std::abs(pivot) > 0.0) || std::abs(pivot) < pivot_tolerance * largest) return false;
+
+            u_values[diagonal] = pivot;
+            for (const auto l : ext::range(l_offsets[k] + 1, l_offsets[k + 1])) {
+                l_values[l] = x[l_rows[l]] / pivot;
+                x[l_rows[l]] = T{};
+            }
+        }
+
+        return true;
+    }
+
+    void factor(const sparse_matrix<T>& a, const double pivot_tolerance) {
+        std::vector<T> x(n);
+        pinv.assign(n, none);
+        pattern.assign(n, 0);
+        stack.resize(n);
+        positions.resize(n);
+        visited.assign(n, 0);
+        stamp = 0;
+
+        l_offsets.assign(1, 0);
+        u_offsets.assign(1, 0);
+        l_rows.clear();
+        l_values.clear();
+        u_rows.clear();
+        u_values.clear();
+        prune_ends.assign(n, none);
+        l_rows.reserve(2 * a.nnz());
+        l_values.reserve(2 * a.nnz());
+        u_rows.reserve(2 * a.nnz());
+        u_values.reserve(2 * a.nnz());
+
+        for (const auto k : ext::range(0, n)) {
+            const auto col = q[k];
+
+            // x = L \ A(:, col) on the pattern of the solution only
+            const auto top = reach(a, col);
+            for (const auto& e : a.row(col)) x[e.col] = e.value;
+
+            for (const auto p : ext::range(top, n)) {
+                const auto j = pattern[p];
+                const auto pivot_col = pinv[j];
+                if (pivot_col == none) continue;
+
+                const auto xj = x[j];
+                for (const auto l : ext::range(l_offsets[pivot_col] + 1, l_offsets[pivot_col + 1])) {
+                    x[l_rows[l]] -= l_values[l] * xj;
+                }
+            }
+
+            // rows already pivoted go to U, the largest of the others becomes the pivot
+            auto pivot_row = none;
+            double largest{-1.0};
+            for (const auto p : ext::range(top, n)) {
+                const auto i = pattern[p];
+                if (pinv[i] == none) {
+                    const double magnitude = std::abs(x[i]);
+                    if (magnitude > largest) {
+                        largest = magnitude;
+                        pivot_row = i;
+                    }
+                } else {
+                    u_rows.push_back(pinv[i]);
+                    u_values.push_back(x[i]);
+                }
+            }
+
+            if (pivot_row == none || !(largest > 0.0)) throw singular_matrix{col};
+            if (pinv[col] == none && std::abs(x[col]) >= pivot_tolerance * largest) pivot_row = col;
+
+            const auto pivot = x[pivot_row];
+            u_rows.push_back(k);
+            u_values.push_back(pivot);
+            u_offsets.push_back(u_rows.size());
+
+            pinv[pivot_row] = k;
+            prune(k, pivot_row);
+            l_rows.push_back(pivot_row);
+            l_values.push_back(T{1});
+            for (const auto p : ext::range(top, n)) {
+                const auto i = pattern[p];
+                if (pinv[i] == none) {
+                    l_rows.push_back(i);
+                    l_values.push_back(x[i] / pivot);
+                }
+                x[i] = T{};
+            }
+            l_offsets.push_back(l_rows.size());
+        }
+
+        // rows of L were recorded before they were pivoted, refer to them by pivot position now
+        for (auto& row : l_rows) row = pinv[row];
+
+        std::vector<std::size_t>{}.swap(pattern);
+        std::vector<std::size_t>{}.swap(stack);
+        std::vector<std::size_t>{}.swap(positions);
+        std::vector<std::size_t>{}.swap(visited);
+        std::vector<std::size_t>{}.swap(prune_ends);
+    }
+
+    /** \brief symmetric pruning (Eisenstat and Liu) of the columns of L used for column k
+        If U(j, k) and L(pivot_row, j) are both nonzero, the rows of L(:, j) not pivoted yet also occur in
+        L(:, k), so the depth-first search reaches them through the pivot row and may skip them in L(:, j).
+        They are moved to the end of the column, past prune_ends[j].
+    */
+    void prune(const std::size_t k, const std::size_t pivot_row) {
+        for (const auto p : ext::range(u_offsets[k], u_offsets[k + 1] - 1)) {
+            const auto j = u_rows[p];
+            if (prune_ends[j] != none) continue;
+
+            const auto first = l_offsets[j] + 1, last = l_offsets[j + 1];
+            if (std::find(std::begin(l_rows) + first, std::begin(l_rows) + last, pivot_row) == std::begin(l_rows) + last) {
+                continue;
+            }
+
+            auto head = first, tail = last;
+            while (head < tail) {
+                if (pinv[l_rows[head]] != none) {
+                    ++head;
+                } else {
+                    --tail;
+                    std::swap(l_rows[head], l_rows[tail]);
+                    std::swap(l_values[head], l_values[tail]);
+                }
+            }
+            prune_ends[j] = tail;
+        }
+    }
+
+    /// @return top such that pattern[top, n) lists the rows reachable from A(:, col) in topological order
+    std::size_t reach(const sparse_matrix<T>& a, const std::size_t col) {
+        ++stamp;
+        auto top = n;
+        for (const auto& e : a.row(col)) {
+            if (visited[e.col] != stamp) top = depth_first(e.col, top);
+        }
+
+        return top;
+    }
+
+    /// @brief non-recursive depth-first search through the graph of L, finished rows are stored in postorder
+    std::size_t depth_first(const std::size_t start, std::size_t top) {
+        std::size_t depth{1};
+        stack[0] = start;
+
+        while (depth != 0) {
+            const auto j = stack[depth - 1];
+            const auto pivot_col = pinv[j];
+            if (visited[j] != stamp) {
+                visited[j] = stamp;
+                positions[depth - 1] = pivot_col == none ? 0 : l_offsets[pivot_col] + 1;
+            }
+
+            auto finished = true;
+            if (pivot_col != none) {
+                const auto end = prune_ends[pivot_col] != none ? prune_ends[pivot_col] : l_offsets[pivot_col + 1];
+                for (auto p = positions[depth - 1]; p < end; ++p) {
+                    const auto i = l_rows[p];
+                    if (visited[i] == stamp) continue;
+
+                    positions[depth - 1] = p + 1;
+                    stack[depth++] = i;
+                    finished = false;
+                    break;
+                }
+            }
+
+            if (finished) {
+                --depth;
+                pattern[--top] = j;
+            }
+        }
+
+        return top;
+    }
+
+    const std::size_t n;
+    const std::vector<std::size_t> q;
+    /// pivot position of every row
+    std::vector<std::size_t> pinv;
+    /// column k of L occupies [l_offsets[k], l_offsets[k + 1]) and starts with its unit diagonal
+    std::vector<std::size_t> l_offsets, l_rows;
+    std::vector<T> l_values;
+    /// column k of U occupies [u_offsets[k], u_offsets[k + 1]) and ends with its diagonal
+    std::vector<std::size_t> u_offsets, u_rows;
+    std::vector<T> u_values;
+
+    /// work space of the factorization, prune_ends[j] ends the part of L(:, j) the search has to visit
+    std::vector<std::size_t> pattern, stack, positions, visited, prune_ends;
+    std::size_t stamp;
+};
+
+template<typename T> const std::size_t sparse_lu<T>::none;
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "range.hpp"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <ostream>
+#include <cstddef>
+
+/** \brief compressed sparse row matrix
+    Nonzero entries of each row are stored contiguously and ordered by column,
+    rows are built sequentially via add_row() followed by push_back() of its entries.
+*/
+template<typename T>
+class sparse_matrix {
+public:
+    struct entry {
+        std::size_t col;
+        T value;
+    };
+
+    class row_range {
+    public:
+        row_range(const entry* first, const entry* last) : first{first}, last{last} {}
+
+        const entry* begin() const { return first; }
+        const entry* end() const { return last; }
+        std::size_t size() const { return last - first; }
+        bool empty() const { return first == last; }
+
+    private:
+        const entry* first;
+        const entry* last;
+    };
+
+    sparse_matrix() : sparse_matrix{0, 0} {}
+    sparse_matrix(const std::size_t row_num, const std::size_t col_num)
+        : cols{col_num}, row_offsets(row_num + 1) {}
+
+    std::size_t row_num() const { return row_offsets.size() - 1; }
+    std::size_t col_num() const { return cols; }
+    std::size_t nnz() const { return entries.size(); }
+
+    row_range row(const std::size_t row) const {
+        if (row >= row_num()) throw std::runtime_error{"row out of bounds"};
+        return { entries.data() + row_offsets[row], entries.data() + row_offsets[row + 1] };
+    }
+
+    /// @brief random access to an element, O(log nnz(row))
+    T operator()(const std::size_t row, const std::size_t col) const {
+        const auto range = this->row(row);
+        const auto it = std::lower_bound(std::begin(range), std::end(range), col,
+            [] (const entry& e, const std::size_t col) { return e.col < col; });
+
+        return it != std::end(range) && it->col == col ? it->value : T{};
+    }
+
+    void reserve(const std::size_t row_num, const std::size_t nnz) {
+        row_offsets.reserve(row_num + 1);
+        entries.reserve(nnz);
+    }
+
+    /// @brief appends an empty row, subsequent push_back() calls fill it
+    void add_row() { row_offsets.push_back(entries.size()); }
+
+    /// @brief appends an entry to the last row, columns must be pushed in increasing order
+    void push_back(const std::size_t col, const T value) {
+        if (col >= cols) throw std::runtime_error{"column out of bounds"};
+        if (row_offsets.size() < 2) throw std::logic_error{"push_back into a matrix without rows"};
+        if (row_offsets[row_offsets.size() - 2] != entries.size() && entries.back().col >= col) {
+            throw std::logic_error{"sparse_matrix entries must be pushed in increasing column order"};
+        }
+
+        entries.push_back({ col, value });
+        ++row_offsets.back();
+    }
+
+    sparse_matrix<T> operator-() const {
+        sparse_matrix<T> result{*this};
+
+        for (auto& e : result.entries) e.value = -e.value;
+
+        return result;
+    }
+
+    template<typename U> friend sparse_matrix<U> transpose(const sparse_matrix<U>& m);
+
+private:
+    std::size_t cols;
+    /// row i occupies entries [row_offsets[i], row_offsets[i + 1])
+    std::vector<std::size_t> row_offsets;
+    std::vector<entry> entries;
+};
+
+template<typename T>
+sparse_matrix<T> slice(const sparse_matrix<T>& m, const std::size_t row_num, const std::size_t col_num,
+                       const std::size_t row_start = 0, const std::size_t col_start = 0) {
+    if (row_start + row_num > m.row_num() || col_start + col_num > m.col_num()) {
+        throw std::runtime_error{"slice out of bounds"};
+    }
+
+    sparse_matrix<T> result{0, col_num};
+    result.reserve(row_num, 0);
+
+    const auto col_end = col_start + col_num;
+    for (const auto i : ext::range(row_start, row_start + row_num)) {
+        result.add_row();
+
+        const auto row = m.row(i);
+        auto it = std::lower_bound(std::begin(row), std::end(row), col_start,
+            [] (const typename sparse_matrix<T>::entry& e, const std::size_t col) { return e.col < col; });
+        for (; it != std::end(row) && it->col < col_end; ++it) {
+            result.push_back(it->col - col_start, it->value);
+        }
+    }
+
+    return result;
+}
+
+template<typename T>
+inline sparse_matrix<T> reduce_last_row(const sparse_matrix<T>& m) {
+    if (m.row_num() < 1) throw std::logic_error{"reduce_last_row on a matrix without rows"};
+
+    return slice(m, m.row_num() - 1, m.col_num());
+}
+
+/// @brief counting sort by column, O(nnz + rows + cols)
+template<typename T>
+sparse_matrix<T> transpose(const sparse_matrix<T>& m) {
+    sparse_matrix<T> result{m.col_num(), m.row_num()};
+    result.entries.resize(m.nnz());
+
+    for (const auto& e : m.entries) ++result.row_offsets[e.col + 1];
+    for (const auto i : ext::range(0, m.col_num())) {
+        result.row_offsets[i + 1] += result.row_offsets[i];
+    }
+
+    auto next = result.row_offsets;
+    for (const auto i : ext::range(0, m.row_num())) {
+        for (const auto& e : m.row(i)) {
+            result.entries[next[e.col]++] = { i, e.value };
+        }
+    }
+
+    return result;
+}
+
+/// @brief entry of a matrix in coordinate form
+template<typename T>
+struct triplet {
+    std::size_t row;
+    std::size_t col;
+    T value;
+};
+
+/** \brief assembles a matrix from entries given in any order, duplicates are summed
+    Entries are bucketed by row and each row is then sorted by column, O(nnz log(max row length) + rows).
+*/
+template<typename T>
+sparse_matrix<T> from_triplets(const std::size_t row_num, const std::size_t col_num,
+                               const std::vector<triplet<T>>& triplets) {
+    std::vector<std::size_t> offsets(row_num + 1);
+    for (const auto& t : triplets) {
+        if (t.row >= row_num || t.col >= col_num) throw std::runtime_error{"triplet out of bounds"};
+        ++offsets[t.row + 1];
+    }
+    for (const auto i : ext::range(0, row_num)) offsets[i + 1] += offsets[i];
+
+    std::vector<typename sparse_matrix<T>::entry> bucketed(triplets.size());
+    auto next = offsets;
+    for (const auto& t : triplets) bucketed[next[t.row]++] = { t.col, t.value };
+
+    sparse_matrix<T> result{0, col_num};
+    result.reserve(row_num, triplets.size());
+    for (const auto i : ext::range(0, row_num)) {
+        const auto first = std::begin(bucketed) + offsets[i], last = std::begin(bucketed) + offsets[i + 1];
+        std::sort(first, last, [] (const typename sparse_matrix<T>::entry& lhs, const typename sparse_matrix<T>::entry& rhs) {
+            return lhs.col < rhs.col;
+        });
+
+        result.add_row();
+        for (auto it = first; it != last; ) {
+            auto value = it->value;
+            const auto col = it->col;
+            for (++it; it != last && it->col == col; ++it) value += it->value;
+            result.push_back(col, value);
+        }
+    }
+
+    return result;
+}
+
+template<typename T>
+matrix<T> to_dense(const sparse_matrix<T>& m) {
+    matrix<T> result{m.row_num(), m.col_num()};
+
+    for (const auto i : ext::range(0, m.row_num())) {
+        for (const auto& e : m.row(i)) result[i][e.col] = e.value;
+    }
+
+    return result;
+}
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const sparse_matrix<T>& m) {
+    return os << to_dense(m);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "range.hpp"
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+/// @brief FNV-1a hash of a byte range
+inline std::size_t hash_bytes(const char* const data, const std::size_t length) {
+    std::uint64_t result{14695981039346656037ull};
+    for (const auto i : ext::range(0, length)) {
+        result = (result ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+
+    return static_cast<std::size_t>(result);
+}
+
+/// @brief string viewed in place, `hash` is its hash_bytes
+struct name_ref {
+    const char* data;
+    std::size_t length;
+    std::size_t hash;
+};
+
+/// @brief set of strings viewing into a buffer that outlives it, sized up front so that it never rehashes
+class name_set {
+public:
+    explicit name_set(const std::size_t capacity) {
+        std::size_t slot_num{16};
+        while (slot_num < 2 * capacity) slot_num *= 2;
+        slots.resize(slot_num);
+    }
+
+    /// @return false if the name is already in the set
+    bool insert(const name_ref& name) {
+        const auto mask = slots.size() - 1;
+        for (auto slot = name.hash & mask; ; slot = (slot + 1) & mask) {
+            auto& entry = slots[slot];
+            if (!entry.data) {
+                entry = name;
+                return true;
+            }
+
+            if (entry.hash == name.hash && entry.length == name.length &&
+                std::memcmp(entry.data, name.data, name.length) == 0) return false;
+        }
+    }
+
+private:
+    std::vector<name_ref> slots;
+};
+
+/** \brief interned strings referred to by dense 32-bit ids
+    Every distinct string is stored once in a single character pool; lookup goes through an
+    open-addressing hash table of ids with linear probing, kept at most half full.
+*/
+class symbol_table {
+public:
+    using id = std::uint32_t;
+    enum : id { npos = static_cast<id>(-1) };
+
+    symbol_table() : slots(16, npos) {}
+
+    std::size_t size() const { return offsets.size(); }
+
+    void reserve(const std::size_t symbol_num, const std::size_t pool_size) {
+        offsets.reserve(symbol_num);
+        lengths.reserve(symbol_num);
+        pool.reserve(pool_size);
+        if (2 * symbol_num > slots.size()) rehash(2 * symbol_num);
+    }
+
+    /// @return id of the string, adding it to the table if it is not there yet
+    id intern(const char* const data, const std::size_t length) {
+        auto slot = find_slot(data, length);
+        if (slots[slot] != npos) return slots[slot];
+
+        if (2 * (size() + 1) > slots.size()) {
+            rehash(2 * slots.size());
+            slot = find_slot(data, length);
+        }
+
+        const auto result = static_cast<id>(size());
+        offsets.push_back(pool.size());
+        lengths.push_back(static_cast<std::uint32_t>(length));
+        pool.append(data, length);
+        slots[slot] = result;
+
+        return result;
+    }
+
+    id intern(const std::string& str) { return intern(str.data(), str.size()); }
+
+    /// @return id of the string or npos if it has not been interned
+    id find(const char* const data, const std::size_t length) const {
+        return slots[find_slot(data, length)];
+    }
+
+    id find(const std::string& str) const { return find(str.data(), str.size()); }
+
+    const char* data(const id symbol) const { return pool.data() + offsets[symbol]; }
+    std::size_t length(const id symbol) const { return lengths[symbol]; }
+    std::string str(const id symbol) const { return { data(symbol), length(symbol) }; }
+
+private:
+    bool equals(const id symbol, const char* const data, const std::size_t length) const {
+        return lengths[symbol] == length && std::memcmp(this->data(symbol), data, length) == 0;
+    }
+
+    /// @return slot holding the string or the empty slot it would be placed at
+    std::size_t find_slot(const char* const data, const std::size_t length) const {
+        const auto mask = slots.size() - 1;
+        auto slot = hash_bytes(data, length) & mask;
+        while (slots[slot] != npos && !equals(slots[slot], data, length)) slot = (slot + 1) & mask;
+
+        return slot;
+    }
+
+    void rehash(std::size_t slot_num) {
+        std::size_t power{16};
+        while (power < slot_num) power *= 2;
+
+        slots.assign(power, npos);
+        for (const auto symbol : ext::range(id{}, static_cast<id>(size()))) {
+            auto slot = hash_bytes(data(symbol), length(symbol)) & (power - 1);
+            while (slots[slot] != npos) slot = (slot + 1) & (power - 1);
+            slots[slot] = symbol;
+        }
+    }
+
+    std::string pool;
+    std::vector<std::size_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    std::vector<id> slots;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "range.hpp"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <cstddef>
+
+/** \brief fixed set of worker threads with a task queue each, idle workers steal from the others
+    Tasks submitted from outside the pool are dealt to the queues in turn, tasks submitted by a
+    worker go to its own queue. A worker takes the newest task of its own queue and steals the
+    oldest task of another one, so long-running tasks do not hold up whatever is queued behind them.
+*/
+class thread_pool {
+public:
+    explicit thread_pool(const std::size_t thread_num = default_thread_num())
+        : queues(thread_num), pending{}, next_queue{}, stopping{false} {
+        if (thread_num == 0) throw std::logic_error{"thread_pool needs at least one thread"};
+
+        workers.reserve(thread_num);
+        for (const auto i : ext::range(0, thread_num)) workers.emplace_back([this, i] { run(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        ready.notify_all();
+
+        for (auto& worker : workers) worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    std::size_t size() const { return workers.size(); }
+
+    /// @return future for the result of `task`, exceptions thrown by the task are rethrown from get()
+    template<typename F> std::future<typename std::result_of<F()>::type> submit(F task) {
+        using result_type = typename std::result_of<F()>::type;
+
+        const auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+        auto result = packaged->get_future();
+        push([packaged] { (*packaged)(); });
+
+        return result;
+    }
+
+    static std::size_t default_thread_num() {
+        const auto hardware = std::thread::hardware_concurrency();
+        return hardware != 0 ? hardware : 1;
+    }
+
+private:
+    struct task_queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct worker_id {
+        const thread_pool* pool;
+        std::size_t index;
+    };
+
+    static worker_id& current_worker() {
+        static thread_local worker_id id{ nullptr, 0 };
+        return id;
+    }
+
+    void push(std::function<void()> task) {
+        const auto& worker = current_worker();
+        std::size_t index{};
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            index = worker.pool == this ? worker.index : next_queue++ % queues.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{queues[index].mutex};
+            queues[index].tasks.push_back(std::move(task));
+        }
+
+        // a task is counted as pending only once it can be found in a queue
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            ++pending;
+        }
+        ready.notify_one();
+    }
+
+    bool try_pop(const std::size_t index, std::function<void()>& task) {
+        for (const auto offset : ext::range(0, queues.size())) {
+            auto& queue = queues[(index + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock{queue.mutex};
+            if (queue.tasks.empty()) continue;
+
+            if (offset == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void run(const std::size_t index) {
+        current_worker() = { this, index };
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                ready.wait(lock, [this] { return stopping || pending != 0; });
+                if (pending == 0) return;
+
+                // claims one of the queued tasks, there are always at least as many tasks as claims
+                --pending;
+            }
+
+            std::function<void()> task;
+            while (!try_pop(index, task)) std::this_thread::yield();
+
+            task();
+        }
+    }
+
+    std::vector<task_queue> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::size_t pending;
+    std::size_t next_queue;
+    bool stopping;
+};
+
+/// @brief runs task(i) for every i in [0, count) on the pool and waits, rethrowing the first exception by index
+template<typename F>
+void parallel_for(thread_pool& pool, const std::size_t count, F task) {
+    std::vector<std::future<void>> results{};
+    results.reserve(count);
+
+    for (const auto i : ext::range(0, count)) {
+        results.push_back(pool.submit([&task, i] { task(i); }));
+    }
+
+    for (auto& result : results) result.wait();
+    for (auto& result : results) result.get();
+}
@@ -1,39 +1,214 @@
 #pragma once
 
-#include "matrix.hpp"
+#include "sparse_matrix.hpp"
 #include "circuit.hpp"
 #include "range.hpp"
+#include "disjoint_set.hpp"
+#include "node_map.hpp"
+#include <vector>
 
-/// @todo assert no closed loop on edges
-template<typename T = int> matrix<T> to_incidence(const circuit& c) {
+/// @brief node x branch incidence matrix: +1 at the branch tail, -1 at its head
+/// @note a closed loop on a single node yields an empty column
+template<typename T = int> sparse_matrix<T> to_incidence(const circuit& c) {
     const auto node_num = count_nodes(c);
     const auto circuit_size = c.size();
-    matrix<T> incidence{node_num, std::vector<T>(circuit_size)};
 
-    for (const auto col : ext::range(0, circuit_size)) {
-        incidence[c[col].tail][col] = 1;
-        incidence[c[col].head][col] = -1;
+    // assemble branch-wise, transposing then yields rows ordered by branch without any sorting
+    sparse_matrix<T> branch_incidence{0, node_num};
+    branch_incidence.reserve(circuit_size, 2 * circuit_size);
+
+    const auto& tails = c.get_tails();
+    const auto& heads = c.get_heads();
+    for (const auto branch : ext::range(0, circuit_size)) {
+        const auto tail = tails[branch], head = heads[branch];
+        branch_incidence.add_row();
+        if (tail == head) continue;
+
+        if (tail < head) {
+            branch_incidence.push_back(tail, T{1});
+            branch_incidence.push_back(head, T{-1});
+        } else {
+            branch_incidence.push_back(head, T{-1});
+            branch_incidence.push_back(tail, T{1});
+        }
     }
 
-    return incidence;
+    return transpose(branch_incidence);
 }
 
-template<typename T = int> circuit select_spanning_tree(const circuit& c) {
-    const auto reduced_incidence = reduce_last_row(to_incidence<T>(c));
-    const auto echelon = echelonize(reduced_incidence);
+/** \brief splits a circuit into its connected components
+    Components are ordered by their first element, each keeps the relative order and the node
+    numbers of its elements, so its highest numbered node becomes its reference node.
+*/
+inline std::vector<circuit> split_components(const circuit& c) {
+    const node_map nodes{c};
+    std::vector<std::size_t> tails(c.size()), heads(c.size());
+    disjoint_set sets{nodes.size()};
+    for (const auto branch : ext::range(0, c.size())) {
+        tails[branch] = nodes.compact(c.tail(branch));
+        heads[branch] = nodes.compact(c.head(branch));
+        sets.unite(tails[branch], heads[branch]);
+    }
+
+    const auto none = nodes.size();
+    std::vector<std::size_t> component_of(nodes.size(), none);
+    std::vector<circuit> result{};
+    for (const auto branch : ext::range(0, c.size())) {
+        auto& component = component_of[sets.find(tails[branch])];
+        if (component == none) {
+            component = result.size();
+            result.emplace_back();
+        }
 
-    const auto row_num = echelon.size();
-    const auto col_num = c.size();
-    circuit result{col_num};
+        result[component].push_back(c.type(branch), c.tail(branch), c.head(branch),
+            c.name_data(branch), c.name_length(branch), c.value(branch));
+    }
 
-    std::size_t t{}, l{row_num}, row{};
-    for (const auto col : ext::range(0, col_num)) {
-        if (row < row_num && is_equal<T>(echelon[row][col], 1)) {
-            result[t++] = c[col];
-            ++row;
-        } else {
-            result[l++] = c[col];
+    return result;
+}
+
+/** \brief branch order with the spanning tree branches first, followed by the links
+    Branches are taken greedily in their order of appearance, a branch joins the tree unless it
+    closes a loop with the branches already taken. Hence for a normalized circuit voltage-defined
+    branches are preferred for the tree. Runs in O(B α(N)).
+*/
+inline std::vector<std::size_t> spanning_tree_order(const circuit& c) {
+    disjoint_set nodes{count_nodes(c)};
+    const auto& tails = c.get_tails();
+    const auto& heads = c.get_heads();
+
+    std::vector<std::size_t> order{}, links{};
+    order.reserve(c.size());
+    for (const auto branch : ext::range(0, c.size())) {
+        (nodes.unite(tails[branch], heads[branch]) ? order : links).push_back(branch);
+    }
+
+    order.insert(std::end(order), std::begin(links), std::end(links));
+
+    return order;
+}
+
+/// @brief reorders branches so that spanning tree branches come first, see spanning_tree_order
+inline circuit select_spanning_tree(const circuit& c) { return c.permute(spanning_tree_order(c)); }
+
+/** \brief spanning tree rooted at the reference node, i.e. the node dropped by reduce_last_row
+    Built from a circuit ordered by select_spanning_tree, whose first (node count - 1) branches
+    form the tree. Every node except the root refers to its parent through a tree branch.
+*/
+struct rooted_tree {
+    std::vector<std::size_t> parent;
+    std::vector<std::size_t> parent_branch;
+    std::vector<std::size_t> depth;
+
+    std::size_t root() const { return parent.size() - 1; }
+    std::size_t size() const { return parent.size() - 1; }
+};
+
+inline rooted_tree root_spanning_tree(const circuit& c) {
+    const auto node_num = count_nodes(c);
+    const auto tree_size = node_num - 1;
+    if (c.size() < tree_size) throw std::runtime_error{"the circuit graph is not connected"};
+
+    // tree adjacency in compressed form: neighbours of node n are adjacent[offsets[n], offsets[n + 1])
+    std::vector<std::size_t> offsets(node_num + 1), adjacent(2 * tree_size);
+    for (const auto branch : ext::range(0, tree_size)) {
+        ++offsets[c.tail(branch) + 1];
+        ++offsets[c.head(branch) + 1];
+    }
+    for (const auto node : ext::range(0, node_num)) offsets[node + 1] += offsets[node];
+
+    auto next = offsets;
+    for (const auto branch : ext::range(0, tree_size)) {
+        adjacent[next[c.tail(branch)]++] = branch;
+        adjacent[next[c.head(branch)]++] = branch;
+    }
+
+    const auto root = node_num - 1;
+    rooted_tree result{
+        std::vector<std::size_t>(node_num, node_num),
+        std::vector<std::size_t>(node_num, tree_size),
+        std::vector<std::size_t>(node_num)
+    };
+    result.parent[root] = root;
+
+    // breadth-first traversal, `queue` doubles as the list of visited nodes
+    std::vector<std::size_t> queue{root};
+    queue.reserve(node_num);
+    for (std::size_t i{}; i < queue.size(); ++i) {
+        const auto node = queue[i];
+        for (const auto index : ext::range(offsets[node], offsets[node + 1])) {
+            const auto branch = adjacent[index];
+            const auto other = c.tail(branch) == node ? c.head(branch) : c.tail(branch);
+            if (result.parent[other] != node_num) continue;
+
+            result.parent[other] = node;
+            result.parent_branch[other] = branch;
+            result.depth[other] = result.depth[node] + 1;
+            queue.push_back(other);
+        }
+    }
+
+    // a tree with node_num - 1 branches reaches every node only if the graph is connected
+    if (queue.size() != node_num) throw std::runtime_error{"the circuit graph is not connected"};
+
+    return result;
+}
+
+/** \brief fundamental loop matrix B = [B_t | 1] of a circuit ordered by select_spanning_tree
+    Row l holds the loop closed by link l: the link itself, oriented positively, and the tree path
+    leading from its head back to its tail. Each row is produced by climbing from both link ends
+    to their common ancestor, so the cost is proportional to the total loop length.
+*/
+inline sparse_matrix<int> fundamental_loop_matrix(const circuit& c, const rooted_tree& tree) {
+    const auto tree_size = tree.size();
+    const auto branch_num = c.size();
+
+    sparse_matrix<int> result{0, branch_num};
+    result.reserve(branch_num - tree_size, branch_num);
+
+    std::vector<sparse_matrix<int>::entry> loop{};
+    for (const auto link : ext::range(tree_size, branch_num)) {
+        auto u = c.tail(link), v = c.head(link);
+
+        // the loop follows the link from u to v, then the tree path from v back to u
+        loop.clear();
+        while (u != v) {
+            if (tree.depth[u] >= tree.depth[v]) {
+                const auto branch = tree.parent_branch[u];
+                loop.push_back({ branch, c.tail(branch) == u ? -1 : 1 });
+                u = tree.parent[u];
+            } else {
+                const auto branch = tree.parent_branch[v];
+                loop.push_back({ branch, c.tail(branch) == v ? 1 : -1 });
+                v = tree.parent[v];
+            }
         }
+
+        std::sort(std::begin(loop), std::end(loop),
+            [] (const sparse_matrix<int>::entry& lhs, const sparse_matrix<int>::entry& rhs) {
+            return lhs.col < rhs.col;
+        });
+
+        result.add_row();
+        for (const auto& e : loop) result.push_back(e.col, e.value);
+        result.push_back(link, 1);
+    }
+
+    return result;
+}
+
+/// @brief fundamental cut-set matrix D = [1 | -B_t^T] for the fundamental loop matrix B = [B_t | 1]
+inline sparse_matrix<int> fundamental_cutset_matrix(const sparse_matrix<int>& b, const std::size_t tree_size) {
+    const auto branch_num = b.col_num();
+    const auto b_transposed = transpose(b);
+
+    sparse_matrix<int> result{0, branch_num};
+    result.reserve(tree_size, tree_size + b.nnz());
+
+    for (const auto branch : ext::range(0, tree_size)) {
+        result.add_row();
+        result.push_back(branch, 1);
+        for (const auto& e : b_transposed.row(branch)) result.push_back(tree_size + e.col, -e.value);
     }
 
     return result;
@@ -0,0 +1,315 @@
+#pragma once
+
+#include "mna.hpp"
+#include "sparse_lu.hpp"
+#include "equation_writer.hpp"
+#include "instrumentation.hpp"
+#include "range.hpp"
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <ostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <cstddef>
+
+enum class integration_method { backward_euler, trapezoidal, bdf2 };
+
+struct transient_options {
+    /// spacing of the output points, also the largest time step taken
+    double step;
+    double stop;
+    integration_method method;
+    /// local truncation error allowed per step, relative to the magnitude of each unknown
+    double relative_tolerance;
+    /// absolute parts of the allowed error, for node potentials and branch currents
+    double potential_tolerance;
+    double current_tolerance;
+    /// factorizations kept for step sizes used recently, each as large as L and U of G + a C
+    std::size_t cached_factorizations;
+};
+
+inline transient_options make_transient_options(const double step, const double stop,
+                                                const integration_method method = integration_method::trapezoidal) {
+    return { step, stop, method, 1e-3, 1e-6, 1e-9, 4 };
+}
+
+/** \brief integrates G x + C dx/dt = b, the model equations with the derivative terms kept
+    The circuit starts at rest, capacitors uncharged and inductors without current, and the sources
+    switch on at t = 0. The state at 0+ comes from two backward Euler steps of negligible length. The
+    first keeps the capacitor voltages and inductor currents and settles everything else, if need be
+    through impulses such as the current charging a capacitor across a voltage source. The second
+    starts from there and leaves currents consistent with the derivatives.
+
+    Every step solves the companion model (G + a C) x_{n+1} = b + C h_n, where a and the history term
+    h_n depend on the method and the step. The matrix only changes along with a, i.e. with the step
+    size, and then keeps its pattern, so it is refactored numerically with the pivot sequence kept.
+    Step sizes are chosen from the local truncation error, estimated from divided differences of the
+    last accepted points. They are powers of two below the largest step, doubled when the estimate
+    allows and cut on rejection, so that the few matrices in use stay factored in a small cache and
+    a changing step mostly finds its factorization there.
+*/
+class transient_simulation {
+public:
+    transient_simulation(const circuit& c, const mna_layout& layout, const transient_options& options)
+        : cir(c), layout(layout), options(options)
+        , system{instrumentation::measure("mna_assembly", [&c, &layout] { return assemble_pencil(c, layout); })}
+        , accepted{}, rejected{}, factorizations{} {
+        if (!(options.step > 0.0) || !(options.stop > 0.0) || options.cached_factorizations == 0) {
+            throw std::runtime_error{"a transient simulation needs a positive step and stop time"};
+        }
+    }
+
+    /** \brief runs the simulation and calls sink(t, x) for t = 0, step, 2 step, ... up to the stop time
+        Values between the time points the integration took are interpolated linearly.
+    */
+    template<typename Sink> void run(Sink sink) {
+        const instrumentation::scoped_phase phase{"transient"};
+        const auto n = layout.size();
+        const auto max_step = std::min(options.step, options.stop / 50);
+        const auto min_step = options.stop * 1e-14;
+
+        // the state at 0+, with the sources switched on
+        const auto settle = options.step * 1e-9;
+        const auto settled = step(std::vector<double>(n), {}, 0.0, settle, integration_method::backward_euler);
+        points.clear();
+        points.push_back({ 0.0, step(settled, {}, 0.0, settle, integration_method::backward_euler) });
+        history_derivative = derivative(points.back().x);
+
+        std::vector<double> output(n);
+        sink(0.0, points.back().x);
+        std::size_t output_index{1};
+
+        // the step is max_step / 2^level
+        int level{7};
+        while (points.back().t < options.stop) {
+            const auto& current = points.back();
+            auto h = std::ldexp(max_step, -level);
+            if (h < min_step) throw std::runtime_error{"time step too small at t = " + std::to_string(current.t)};
+            // the last step ends at the stop time exactly
+            const auto last = current.t + h * (1 + 1e-9) >= options.stop;
+            if (last) h = options.stop - current.t;
+            const auto t = last ? options.stop : current.t + h;
+
+            const auto method = points.size() < 2 && options.method == integration_method::bdf2
+                ? integration_method::backward_euler : options.method;
+            const auto previous_step = points.size() < 2 ? h : current.t - points[points.size() - 2].t;
+            auto x = step(current.x, points.size() < 2 ? current.x : points[points.size() - 2].x, current.t, h, method,
+                          previous_step);
+
+            const auto order = method == integration_method::backward_euler ? 1 : 2;
+            const auto error = error_norm(t, x, method, order);
+            const auto growth = error > 0.0 ? 0.9 * std::pow(error, -1.0 / (order + 1)) : 2.0;
+            if (error > 1.0) {
+                ++rejected;
+                level += growth < 0.5 ? 2 : 1;
+                continue;
+            }
+
+            ++accepted;
+            if (method == integration_method::trapezoidal) history_derivative = derivative(x);
+
+            // output points up to t, interpolated between the last two time points
+            for (; output_index * options.step <= options.stop * (1 + 1e-12); ++output_index) {
+                const auto time = output_index * options.step;
+                if (time > t * (1 + 1e-12)) break;
+
+                const auto weight = std::min(1.0, (time - current.t) / h);
+                for (const auto i : ext::range(0, n)) output[i] = current.x[i] + weight * (x[i] - current.x[i]);
+                sink(time, output);
+            }
+
+            points.push_back({ t, std::move(x) });
+            if (points.size() > 4) points.pop_front();
+            if (growth >= 2.0 && level > 0) --level;
+        }
+
+        instrumentation::annotate("accepted_steps", accepted);
+        instrumentation::annotate("rejected_steps", rejected);
+        instrumentation::annotate("factorizations", factorizations);
+    }
+
+    std::size_t accepted_steps() const { return accepted; }
+    std::size_t rejected_steps() const { return rejected; }
+    /// @brief numeric factorizations done, cache hits excluded
+    std::size_t factorization_num() const { return factorizations; }
+
+private:
+    struct time_point {
+        double t;
+        std::vector<double> x;
+    };
+
+    /// @return x_{n+1} of a step of size h from `x` at time t, `previous` being x_{n-1} a step `previous_step` earlier
+    std::vector<double> step(const std::vector<double>& x, const std::vector<double>& previous, const double t,
+                             const double h, const integration_method method, const double previous_step = 0.0) {
+        const auto n = layout.size();
+        std::vector<double> history(n);
+        double a{};
+
+        switch (method) {
+        case integration_method::backward_euler:
+            // C (x_{n+1} - x_n) / h
+            a = 1 / h;
+            history = multiply(system.c, x, a);
+            break;
+        case integration_method::trapezoidal:
+            // C (x_{n+1} - x_n) 2 / h - C dx_n/dt
+            a = 2 / h;
+            history = multiply(system.c, x, a);
+            for (const auto i : ext::range(0, n)) history[i] += history_derivative[i];
+            break;
+        case integration_method::bdf2: {
+            // variable step BDF2, ratio = h_n / h_{n-1}
+            const auto ratio = h / previous_step;
+            a = (1 + 2 * ratio) / ((1 + ratio) * h);
+            history = multiply(system.c, x, (1 + ratio) / h);
+            const auto older = multiply(system.c, previous, ratio * ratio / ((1 + ratio) * h));
+            for (const auto i : ext::range(0, n)) history[i] -= older[i];
+            break;
+        }
+        }
+
+        for (const auto i : ext::range(0, n)) history[i] += system.rhs[i];
+
+        try {
+            return factor(a).solve(history);
+        } catch (const singular_matrix& e) {
+            std::ostringstream what{};
+            what << "no transient solution at t = " << t + h;
+            detail::throw_singular(cir, layout, e, what.str());
+        }
+    }
+
+    /** \brief factorization of G + a C, from the cache if possible
+        Otherwise the least recently used entry is refactored, or a copy of the most recent one while
+        the cache is not full, all of them sharing the ordering of the first.
+    */
+    sparse_lu<double>& factor(const double a) {
+        const auto hit = std::find_if(std::begin(factors), std::end(factors),
+            [a] (const cached_factor& f) { return f.coefficient == a; });
+        if (hit != std::end(factors)) {
+            std::rotate(std::begin(factors), hit, hit + 1);
+            return *factors.front().lu;
+        }
+
+        const auto matrix = combine(system, a);
+        if (factors.empty()) {
+            factors.push_back({ a, std::unique_ptr<sparse_lu<double>>{new sparse_lu<double>{matrix}} });
+        } else {
+            if (factors.size() < options.cached_factorizations) {
+                factors.push_back({ a, std::unique_ptr<sparse_lu<double>>{new sparse_lu<double>{*factors.front().lu}} });
+            }
+
+            auto& victim = factors.back();
+            victim.coefficient = a;
+            victim.lu->refactor(matrix);
+            std::rotate(std::begin(factors), std::end(factors) - 1, std::end(factors));
+        }
+
+        ++factorizations;
+        return *factors.front().lu;
+    }
+
+    /// @return factor C x, C being stored by columns
+    static std::vector<double> multiply(const sparse_matrix<double>& columns, const std::vector<double>& x,
+                                        const double factor) {
+        std::vector<double> result(x.size());
+        for (const auto j : ext::range(0, columns.row_num())) {
+            const auto xj = factor * x[j];
+            if (xj == 0.0) continue;
+
+            for (const auto& e : columns.row(j)) result[e.col] += e.value * xj;
+        }
+
+        return result;
+    }
+
+    /// @return C dx/dt at x, read off the equations as b - G x
+    std::vector<double> derivative(const std::vector<double>& x) const {
+        auto result = multiply(system.g, x, -1.0);
+        for (const auto i : ext::range(0, result.size())) result[i] += system.rhs[i];
+
+        return result;
+    }
+
+    /** \brief largest local truncation error of the step to (t, x), relative to the tolerance of each unknown
+        The error is E h^(p+1) x^(p+1), the derivative taken from the divided difference of order p + 1
+        through the new point and the last accepted ones, with E = 1/2 for backward Euler, 1/12 for the
+        trapezoidal rule and 2/9 for BDF2. Too short a history falls back to a lower order difference.
+    */
+    double error_norm(const double t, const std::vector<double>& x, const integration_method method, int order) const {
+        order = std::min<int>(order, static_cast<int>(points.size()) - 1);
+        if (order < 1) return 0.0;
+
+        const auto constant = order == 1 ? 0.5 : method == integration_method::bdf2 ? 2.0 / 9 : 1.0 / 12;
+        const auto h = t - points.back().t;
+        const auto count = static_cast<std::size_t>(order) + 2;
+        const auto first = points.size() + 1 - count;
+
+        std::vector<double> times{}, differences(count);
+        for (const auto p : ext::range(first, points.size())) times.push_back(points[p].t);
+        times.push_back(t);
+
+        double factorial{1.0}, scale{1.0};
+        for (const auto k : ext::range(1, order + 2)) {
+            factorial *= k;
+            scale *= h;
+        }
+
+        double result{};
+        for (const auto i : ext::range(0, x.size())) {
+            for (const auto p : ext::range(0, count - 1)) differences[p] = points[first + p].x[i];
+            differences[count - 1] = x[i];
+
+            for (const auto level : ext::range(1, count)) {
+                for (const auto p : ext::reverse_range(level, count)) {
+                    differences[p] = (differences[p] - differences[p - 1]) / (times[p] - times[p - level]);
+                }
+            }
+
+            const auto absolute = i < layout.potential_num() ? options.potential_tolerance : options.current_tolerance;
+            const auto tolerance = absolute + options.relative_tolerance * std::max(std::abs(x[i]), std::abs(points.back().x[i]));
+            result = std::max(result, std::abs(constant * factorial * scale * differences[count - 1]) / tolerance);
+        }
+
+        return result;
+    }
+
+    const circuit& cir;
+    const mna_layout& layout;
+    const transient_options options;
+    const mna_pencil system;
+
+    struct cached_factor {
+        double coefficient;
+        std::unique_ptr<sparse_lu<double>> lu;
+    };
+
+    /// factorizations of G + a C, most recently used first
+    std::vector<cached_factor> factors;
+    /// last accepted time points, oldest first, and C dx/dt at the last one for the trapezoidal rule
+    std::deque<time_point> points;
+    std::vector<double> history_derivative;
+
+    std::size_t accepted, rejected, factorizations;
+};
+
+/// @brief tab separated table, a header naming the unknowns, then a line per output time point
+void write_transient(std::ostream& os, const circuit& c, const mna_layout& layout, const transient_options& options) {
+    buffered_writer out{os};
+    out << "time";
+    for (const auto i : ext::range(0, layout.size())) layout.write_name(out << '\t', c, i);
+    out << '\n';
+
+    char digits[32];
+    transient_simulation{c, layout, options}.run([&] (const double t, const std::vector<double>& values) {
+        out.write(digits, std::snprintf(digits, sizeof(digits), "%.9g", t));
+        for (const auto value : values) out.write(digits, std::snprintf(digits, sizeof(digits), "\t%.9g", value));
+        out << '\n';
+    });
+}